@@ -15,124 +15,216 @@
 #include <map>
 #include <cstdio>
 #include <set>
+#include <unordered_map>
+#include <unordered_set>
 #include <queue>
 #include <algorithm>
 #include <iterator>
 #include <sstream>
-
-#define noEdge -1       // dfa simplify 宏变量
-
-#define DIV_CHAR '+'    // 这是用来分隔的字符，表示连接
+#include <chrono>
+#include <cstdint>
+#include <cerrno>
+#include <cctype>
+#include <bitset>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 bool CHECK_ON = false;  // 是否开启检查内容的输入输出
+const char *CACHE_DIR = nullptr;  // 编译缓存所在的目录，取自环境变量REGEX_CACHE_DIR，为空时不用缓存
+bool STATS_ON = false;  // 是否在标准错误输出正则编译各阶段的统计(JSON)，环境变量REGEX_STATS不为空也不为0时开启
 
-namespace regex2nfa
+// 按1MiB的块read(2)读完fd，被信号打断时重读；每读到一块调用block(s, n, offset)，
+// offset为这一块在整个输入中的位置。供各个流式的scan()使用
+template <typename Block>
+void readChunks(int fd, Block block)
 {
-    class State
+    std::vector<char> buf(1 << 20);
+    long long offset = 0;
+    for (;;)
     {
-    public:
-        int ID{};
-        std::map<char, State *> transitions;
-        std::vector<State *> transitions_e;
-        bool isEnd{};
-    public:
-        State() = default;
-
-        explicit State(int ID)
-        {
-            this->ID = ID;
-        }
+        ssize_t n = read(fd, buf.data(), buf.size());
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        block(buf.data(), (std::size_t) n, offset);
+        offset += n;
+    }
+}
 
-        State(int ID, bool isEnd)
-        {
-            this->ID = ID;
-            this->isEnd = isEnd;
-        }
+namespace regex2nfa
+{
+    const int EPS = -1;     // 边上的符号：EPS为~边，0..255为字节，256+k为字符类NFA::sets[k]
+
+    // 记号：非负的是操作数(同边上的符号)，负的是运算符；连接用CONCAT，不再占用输入里的字符
+    const int CONCAT = -2;
+    const int ALT = -3;     // |
+    const int STAR = -4;    // *
+    const int PLUS = -5;    // +
+    const int QUEST = -6;   // ?
+    const int LPAREN = -7;
+    const int RPAREN = -8;
+    const int EMPTY = -9;   // 只接受空串的操作数，来自{0}这样的重复
+
+    // 重复展开后的记号数上限。a{m,n}要把a拷贝n份，嵌套的重复还会相乘，不限制的话
+    // a{100000}、(a{1000}){1000}这样的正则会让后面的构造耗尽时间和内存
+    const std::size_t MAX_TOKENS = 50000;
+
+    // NFA的一条边，按起点存放在NFA::edges中
+    struct Edge
+    {
+        int symbol;
+        int target;
     };
 
+    // Thompson构造中的片段：一个入口状态和一个出口状态，按值保存在栈上
     class Fragment
     {
     public:
-        State *state_start;
-        State *state_end;
+        int state_start = -1;
+        int state_end = -1;
     public:
         Fragment() = default;
 
-        Fragment(State *start, State *end)
+        Fragment(int start, int end)
         {
             this->state_start = start;
             this->state_end = end;
         }
     };
 
+    // 状态就是0..stateCount-1的编号，由计数器递增分配；边按CSR存放：
+    // 状态s的边为edges[offset[s]]..edges[offset[s+1]-1]。构造时边先追加到pending，
+    // finish()再按起点一次排好
     class NFA
     {
     public:
-        std::vector<State *> states;
+        int stateCount = 0;
+        std::vector<int> offset;
+        std::vector<Edge> edges;
+        int start = -1;
+        int accept = -1;
+        std::vector<std::pair<int, Edge> > pending;  // (起点, 边)
+        std::vector<std::bitset<256> > sets;         // 字符类，[a-z]这样的类只占一条边
 
     public:
-        NFA() = default;
+        int newState()
+        {
+            return stateCount++;
+        }
+
+        void addEdge(int from, int symbol, int to)
+        {
+            Edge edge;
+            edge.symbol = symbol;
+            edge.target = to;
+            pending.push_back(std::make_pair(from, edge));
+        }
 
-        void removeState(const State *state)
+        // 加入字符类，返回边上用的符号；相同的类只存一份
+        int addSet(const std::bitset<256> &set)
         {
-            for (auto it = this->states.begin(); it != this->states.end(); it++)
+            for (std::size_t k = 0; k < sets.size(); k++)
             {
-                if ((*it)->ID == state->ID)
-                {
-                    State *p = *it;
-                    this->states.erase(it);
-                    if (p != nullptr)
-                    {
-                        delete p;
-                        break;
-                    }
-                }
+                if (sets[k] == set)
+                    return 256 + k;
             }
+            sets.push_back(set);
+            return 256 + sets.size() - 1;
+        }
+
+        // 符号为symbol的边能否读入字节c
+        bool matches(int symbol, unsigned char c) const
+        {
+            if (symbol < 256)
+                return symbol == c;
+            return sets[symbol - 256].test(c);
         }
 
-        ~NFA()
+        // 字节等价类：能读入它的边的符号完全相同的字节归为一类，哪条边都不读的字节是0类；
+        // 返回类的个数(含0类)
+        int byteClasses(std::vector<unsigned char> &byteClass) const
         {
-            for (const State *i : states)
+            std::vector<bool> literal(256, false);
+            for (const Edge &e : edges)
             {
-                delete i;
+                if (e.symbol >= 0 && e.symbol < 256)
+                    literal[e.symbol] = true;
+            }
+            std::map<std::vector<int>, int> classOf;
+            byteClass.assign(256, 0);
+            for (int c = 0; c < 256; c++)
+            {
+                std::vector<int> symbols;
+                if (literal[c])
+                    symbols.push_back(c);
+                for (std::size_t k = 0; k < sets.size(); k++)
+                {
+                    if (sets[k].test(c))
+                        symbols.push_back(256 + k);
+                }
+                if (symbols.empty())
+                    continue;
+                int id = classOf.size() + 1;
+                byteClass[c] = classOf.insert(std::make_pair(symbols, id)).first->second;
             }
+            return classOf.size() + 1;
+        }
+
+        // 按起点做计数排序，同一状态的边保持加入的顺序
+        void finish()
+        {
+            offset.assign(stateCount + 1, 0);
+            for (const std::pair<int, Edge> &p : pending)
+                offset[p.first + 1]++;
+            for (int i = 0; i < stateCount; i++)
+                offset[i + 1] += offset[i];
+            edges.resize(pending.size());
+            std::vector<int> fill(offset.begin(), offset.end() - 1);
+            for (const std::pair<int, Edge> &p : pending)
+                edges[fill[p.first]++] = p.second;
+            pending.clear();
+            pending.shrink_to_fit();
+        }
+
+        const Edge *edgeBegin(int state) const
+        {
+            return edges.data() + offset[state];
+        }
+
+        const Edge *edgeEnd(int state) const
+        {
+            return edges.data() + offset[state + 1];
         }
     };
 
     class Regex2Nfa
     {
     private:
-        const char explicitC = DIV_CHAR;
         std::string input;          // 原始的输入字符串
-        std::string strBeInsert;    // 插入分隔符后的字符串
-        std::string strPostfix;
-        std::string alphaBet;       // 字母表
-        std::map<char, int> op_priority;  // 运算符优先级
+        std::vector<int> tokens;    // 插入连接符后的记号序列
+        std::vector<int> postfix;   // 后缀式
+        std::map<int, int> op_priority;  // 运算符优先级
         NFA nfa;
+        std::string error;          // insertExplicit()拒绝这个正则的原因
 
         // 输入输出
     public:
         Regex2Nfa()
         {
-            alphaBet = std::string();
-            char tempChar;
-            // init alphaBet as [A,B,C,...,a,b,c,...,0,1,2,...]
-            for (int i = 'A'; i < 'Z' + 1; i++)
-            {
-                tempChar = char(i);
-                alphaBet.push_back(tempChar);
-                tempChar = char(i + 'a' - 'A');
-                alphaBet.push_back(tempChar);
-            }
-            for (int i = '0'; i < '9' + 1; i++)
-            {
-                tempChar = char(i);
-                alphaBet.push_back(tempChar);
-            }
-            op_priority['*'] = 4;
-            op_priority['|'] = 3;
-            op_priority[explicitC] = 2;
-            op_priority['('] = 0;
+            op_priority[STAR] = 4;
+            op_priority[PLUS] = 4;
+            op_priority[QUEST] = 4;
+            op_priority[CONCAT] = 3;
+            op_priority[ALT] = 2;
+            op_priority[LPAREN] = 0;
         }
 
         void getInput()
@@ -145,299 +237,190 @@ namespace regex2nfa
             input = inputT;
         }
 
+        const NFA &getNFA() const
+        {
+            return nfa;
+        }
+
+        const std::string &getError() const
+        {
+            return error;
+        }
+
+        const std::vector<int> &getTokens() const
+        {
+            return tokens;
+        }
+
+        const std::vector<int> &getPostfix() const
+        {
+            return postfix;
+        }
+
         void outputOrigin()
         {
-            for (const State *state : nfa.states)
+            for (int state = 0; state < nfa.stateCount; state++)
             {
-                if (state == nfa.states.back())
+                if (state == nfa.accept)
                 {
                     continue;
                 }
-                std::cout << state->ID << " ";
-
-                for (State *const state_item : state->transitions_e)
-                {
-                    std::cout << state->ID << "-~->" << state_item->ID << " ";
-                }
-
-                for (std::pair<const char, State *> pairTemp : state->transitions)
+                std::cout << state << " ";
+                for (const Edge *e = nfa.edgeBegin(state); e != nfa.edgeEnd(state); e++)
                 {
-                    std::cout << state->ID << "-" <<
-                              pairTemp.first << "->" << pairTemp.second->ID << " ";
+                    for (const std::string &symbol : symbolNames(e->symbol))
+                        std::cout << state << "-" << symbol << "->" << e->target << " ";
                 }
                 std::cout << std::endl;
             }
         }
 
+        // 初态写成X，终态写成Y，X一行后面接一行Y，其余状态各一行
         void output()
         {
-            for (const State *state : nfa.states)
+            auto name = [this](int state) -> std::string
             {
-                if (state == nfa.states.front())
-                {
-                    std::cout << "X ";
-                    for (State *const state_item : state->transitions_e)
-                    {
-                        if (state_item->ID == nfa.states.back()->ID)
-                        {
-                            std::cout << "X-~->Y ";
-                        } else
-                        {
-                            std::cout << "X-~->" << state_item->ID << " ";
-                        }
-                    }
-                    for (std::pair<const char, State *> pairTemp : state->transitions)
-                    {
-                        if (pairTemp.second->ID == nfa.states.back()->ID)
-                        {
-                            std::cout << "X-" <<
-                                      pairTemp.first << "->Y ";
-                        } else
-                        {
-                            std::cout << "X-" <<
-                                      pairTemp.first << "->" << pairTemp.second->ID << " ";
-                        }
-                    }
-                    std::cout << std::endl << "Y" << std::endl;
-                } else if (state == nfa.states.back())
+                if (state == nfa.start)
+                    return "X";
+                if (state == nfa.accept)
+                    return "Y";
+                return std::to_string(state);
+            };
+            std::vector<int> order(1, nfa.start);
+            for (int state = 0; state < nfa.stateCount; state++)
+            {
+                if (state != nfa.start && state != nfa.accept)
+                    order.push_back(state);
+            }
+            for (int state : order)
+            {
+                std::cout << name(state) << " ";
+                for (const Edge *e = nfa.edgeBegin(state); e != nfa.edgeEnd(state); e++)
                 {
-                    continue;
-                } else
+                    for (const std::string &symbol : symbolNames(e->symbol))
+                        std::cout << name(state) << "-" << symbol << "->" << name(e->target) << " ";
+                }
+                std::cout << std::endl;
+                if (state == nfa.start)
                 {
-                    std::cout << state->ID << " ";
-                    for (State *const state_item : state->transitions_e)
-                    {
-                        if (state_item->ID == nfa.states.back()->ID)
-                        {
-                            std::cout << state->ID << "-" <<
-                                      '~' << "->Y ";
-                        } else
-                        {
-                            std::cout << state->ID << "-" <<
-                                      '~' << "->" << state_item->ID << " ";
-                        }
-                    }
-
-                    for (std::pair<const char, State *> pairTemp : state->transitions)
-                    {
-
-                        if (pairTemp.second->ID == nfa.states.back()->ID)
-                        {
-                            std::cout << state->ID << "-" <<
-                                      pairTemp.first << "->" << "Y";
-                        } else
-                        {
-                            std::cout << state->ID << "-" <<
-                                      pairTemp.first << "->" << pairTemp.second->ID << " ";
-                        }
-                    }
-                    std::cout << std::endl;
+                    std::cout << "Y" << std::endl;
                 }
-
             }
         }
 
+        // 写出tmp_nfa_orign.txt，格式见nfa2dfa::readAutomaton；文本格式一条边只有一个字母，
+        // 字符类在这里按字节展开
         void outputToFile()
         {
-            std::streambuf *coutBuf = std::cout.rdbuf();
             std::ofstream of("tmp_nfa_orign.txt");
-            std::streambuf *fileBuf = of.rdbuf();
-            std::cout.rdbuf(fileBuf);
-
-            for (const State *state : nfa.states)
+            of << "X " << nfa.start << std::endl;
+            of << "Y " << nfa.accept << std::endl;
+            for (int state = 0; state < nfa.stateCount; state++)
             {
-                // 对于第一个X的输出
-                if (state == nfa.states.front())
-                {
-                    int countE = 0, countEdge = 0;
-                    for (State *const state_item : state->transitions_e)
-                    {
-                        countE++;
-                    }
-                    for (std::pair<const char, State *> pairTemp : state->transitions)
-                    {
-                        countEdge++;
-                    }
-                    std::cout << "X ";
-                    for (State *const state_item : state->transitions_e)
-                    {
-                        countE--;
-                        if (countE == 0 && countEdge == 0)
-                        {
-                            if (state_item->ID == nfa.states.back()->ID)
-                            {
-                                std::cout << "X-~->Y";
-                            } else
-                            {
-                                std::cout << "X-~->" << state_item->ID;
-                            }
-                        } else
-                        {
-                            if (state_item->ID == nfa.states.back()->ID)
-                            {
-                                std::cout << "X-~->Y";
-                            } else
-                            {
-                                std::cout << "X-~->" << state_item->ID << " ";
-                            }
-                        }
-                    }
-                    for (std::pair<const char, State *> pairTemp : state->transitions)
-                    {
-                        countEdge--;
-                        if (countEdge == 0)
-                        {
-                            if (pairTemp.second->ID == nfa.states.back()->ID)
-                            {
-                                std::cout << "X-" <<
-                                          pairTemp.first << "->Y";
-                            } else
-                            {
-                                std::cout << "X-" <<
-                                          pairTemp.first << "->" << pairTemp.second->ID;
-                            }
-                        } else
-                        {
-                            if (pairTemp.second->ID == nfa.states.back()->ID)
-                            {
-                                std::cout << "X-" <<
-                                          pairTemp.first << "->Y";
-                            } else
-                            {
-                                std::cout << "X-" <<
-                                          pairTemp.first << "->" << pairTemp.second->ID << " ";
-                            }
-                        }
-                    }
-                    std::cout << std::endl << "Y " << std::endl;
-                } else if (state == nfa.states.back())
-                {
-                    continue;
-                } else
+                of << state;
+                for (const Edge *e = nfa.edgeBegin(state); e != nfa.edgeEnd(state); e++)
                 {
-                    // 对于后面的
-                    int countE = 0, countEdge = 0;
-                    for (State *const state_item : state->transitions_e)
-                    {
-                        countE++;
-                    }
-                    for (std::pair<const char, State *> pairTemp : state->transitions)
-                    {
-                        countEdge++;
-                    }
-                    std::cout << state->ID << " ";
-                    for (State *const state_item : state->transitions_e)
-                    {
-                        countE--;
-                        if (countE == 0 && countEdge == 0)
-                        {
-                            if (state_item->ID == nfa.states.back()->ID)
-                            {
-                                std::cout << state->ID << "-" <<
-                                          '~' << "->Y ";
-                            } else
-                            {
-                                std::cout << state->ID << "-" <<
-                                          '~' << "->" << state_item->ID;
-                            }
-                        } else
-                        {
-                            if (state_item->ID == nfa.states.back()->ID)
-                            {
-                                std::cout << state->ID << "-" <<
-                                          '~' << "->Y ";
-                            } else
-                            {
-                                std::cout << state->ID << "-" <<
-                                          '~' << "->" << state_item->ID << " ";
-                            }
-                        }
-                    }
-
-                    for (std::pair<const char, State *> pairTemp : state->transitions)
-                    {
-                        countEdge--;
-                        if (countEdge == 0)
-                        {
-                            if (pairTemp.second->ID == nfa.states.back()->ID)
-                            {
-                                std::cout << state->ID << "-" <<
-                                          pairTemp.first << "->" << "Y";
-                            } else
-                            {
-                                std::cout << state->ID << "-" <<
-                                          pairTemp.first << "->" << pairTemp.second->ID;
-                            }
-                        } else
-                        {
-                            if (pairTemp.second->ID == nfa.states.back()->ID)
-                            {
-                                std::cout << state->ID << "-" <<
-                                          pairTemp.first << "->" << "Y";
-                            } else
-                            {
-                                std::cout << state->ID << "-" <<
-                                          pairTemp.first << "->" << pairTemp.second->ID << " ";
-                            }
-                        }
-                    }
-                    std::cout << std::endl;
+                    for (const std::string &symbol : symbolNames(e->symbol))
+                        of << ' ' << state << '-' << symbol << "->" << e->target;
                 }
-
+                of << std::endl;
             }
-
-            of.flush();
             of.close();
-
-            std::cout.rdbuf(coutBuf);
         }
 
     public:
-        // 向正则表达式中插入分隔符号
-        void insertExplicit()
-        {
-            strBeInsert = input;
-            bool shouldInsert = false;
-            int count = 0;  // 用于标记当前扫描到的字符
-            for (unsigned int i = 0; i < input.length() - 1; i++, count++)
-            {
-                // 对于如ab,a(c),a*(c),(a)b,a*b,五种状态
-                // 替换成a_b,a_(c),a*_(c),(a)_b,a*_b
-                if (isCharInStr(alphaBet, strBeInsert[count]) &&
-                    (isCharInStr(alphaBet, strBeInsert[count + 1]) || strBeInsert[count + 1] == '('))
-                {
-                    // 对于两个字母相邻，插入分隔
-                    shouldInsert = true;
-                } else if (strBeInsert[count] == '*' &&
-                           strBeInsert[count + 1] == '(')
-                {
-                    // 对于字母或者'*'与'('相邻，插入分隔
-                    shouldInsert = true;
-                } else if (strBeInsert[count] == ')' && isCharInStr(alphaBet, strBeInsert[count + 1]))
-                {
-                    // 对于')'和字母相邻，插入分隔
-                    shouldInsert = true;
-                } else if (strBeInsert[count] == '*' && isCharInStr(alphaBet, strBeInsert[count + 1]))
+        // 把输入切成记号，同时插入连接符
+        // 支持的语法：字面字符，.，[a-z0-9_]，[^...]，\转义(\n \t \r \f \v \xHH \d \w \s \D \W \S，
+        // 其余字符转义后都是它本身)，| * + ? ( )，以及重复a{m} a{m,} a{,n} a{m,n}。
+        // 左边是操作数、后缀运算符或')'，右边是操作数或'('时中间是连接，如ab,a(c),a*(c),(a)b
+        // 有不配对的')'或重复展开后超过MAX_TOKENS个记号时返回false，原因见getError()
+        bool insertExplicit()
+        {
+            error.clear();
+            tokens.clear();
+            std::vector<int> raw;
+            std::vector<std::size_t> groups;   // 未闭合的'('在raw中的位置
+            std::size_t atom = 0;               // 最近一个操作数(或括号组)在raw中开始的位置
+            std::size_t i = 0;
+            while (i < input.length())
+            {
+                char ch = input[i];
+                std::size_t next = i + 1;
+                switch (ch)
                 {
-                    // 对于*和字母相邻，插入分隔
-                    shouldInsert = true;
+                    case '|':
+                        raw.push_back(ALT);
+                        break;
+                    case '*':
+                        raw.push_back(STAR);
+                        break;
+                    case '+':
+                        raw.push_back(PLUS);
+                        break;
+                    case '?':
+                        raw.push_back(QUEST);
+                        break;
+                    case '(':
+                        groups.push_back(raw.size());
+                        raw.push_back(LPAREN);
+                        break;
+                    case ')':
+                        if (groups.empty())
+                        {
+                            error = "unmatched ) at position " + std::to_string(i);
+                            return false;
+                        }
+                        atom = groups.back();
+                        groups.pop_back();
+                        raw.push_back(RPAREN);
+                        break;
+                    case '{':
+                        if (parseRepeat(i, next, atom, raw))
+                        {
+                            if (!error.empty())
+                                return false;
+                            break;
+                        }
+                        atom = raw.size();
+                        raw.push_back((unsigned char) ch);
+                        break;
+                    default:
+                        atom = raw.size();
+                        raw.push_back(parseAtom(i, next));
+                        break;
                 }
+                i = next;
+            }
 
-                if (shouldInsert)
+            // 缺操作数的地方(如"a|"、"()"、"|b")补一个EMPTY，后面的构造就不会出现栈空
+            tokens.clear();
+            tokens.reserve(raw.size() * 2 + 1);
+            bool needOperand = true;
+            for (int token : raw)
+            {
+                bool binaryOrPostfix = token == ALT || token == RPAREN || token == STAR || token == PLUS || token == QUEST;
+                if (needOperand && binaryOrPostfix)
+                    tokens.push_back(EMPTY);
+                if (!tokens.empty() && (isOperand(token) || token == LPAREN) &&
+                    (isOperand(tokens.back()) || tokens.back() == STAR || tokens.back() == PLUS ||
+                     tokens.back() == QUEST || tokens.back() == RPAREN))
                 {
-                    strBeInsert.insert(count + 1, std::string(1, explicitC));
-                    count++;
-                    shouldInsert = false;
+                    tokens.push_back(CONCAT);
                 }
+                tokens.push_back(token);
+                needOperand = token == ALT || token == LPAREN;
             }
+            if (needOperand)
+                tokens.push_back(EMPTY);
+            return true;
         }
 
         // 转成后缀表达式
         void convertToPostfix()
         {
-            std::string outputPostfix;
-            std::vector<char> op_stack;
-            char tempChar;
+            std::vector<int> outputPostfix;
+            std::vector<int> op_stack;
+            int tempToken;
 
             //    转后缀表达式
             //    1.遇到操作数，直接输出；
@@ -447,224 +430,503 @@ namespace regex2nfa
             //    5.遇到其他运算符’+”-”*”/’时，弹出所有优先级大于或等于该运算符的栈顶元素，然后将该运算符入栈；
             //    6.最终将栈中的元素依次出栈，输出。
             //    举例：a+b*c+(d*e+f)g ———> abc*+de*f+g*+
-            for (char ch : strBeInsert)
+            for (int token : tokens)
             {
-                if (isCharInStr(alphaBet, ch))
+                if (isOperand(token))
                 {
-                    outputPostfix.push_back(ch);
+                    outputPostfix.push_back(token);
                 } else
                 {
-                    if (op_stack.empty() || ch == '(')
+                    if (op_stack.empty() || token == LPAREN)
                     {
-                        op_stack.push_back(ch);
-                    } else if (ch == ')')
+                        op_stack.push_back(token);
+                    } else if (token == RPAREN)
                     {
-                        while (op_stack.back() != '(')
+                        while (!op_stack.empty() && op_stack.back() != LPAREN)
                         {
-                            tempChar = op_stack.back();
-                            outputPostfix.push_back(tempChar);
+                            tempToken = op_stack.back();
+                            outputPostfix.push_back(tempToken);
                             op_stack.pop_back();
                         }
-                        op_stack.pop_back();
+                        if (!op_stack.empty())
+                            op_stack.pop_back();
                     } else
                     {
-                        while (!op_stack.empty() && op_priority[ch] <= op_priority[op_stack.back()])
+                        while (!op_stack.empty() && op_priority[token] <= op_priority[op_stack.back()])
                         {
-                            tempChar = op_stack.back();
-                            outputPostfix.push_back(tempChar);
+                            tempToken = op_stack.back();
+                            outputPostfix.push_back(tempToken);
                             op_stack.pop_back();
                         }
-                        op_stack.push_back(ch);
+                        op_stack.push_back(token);
                     }
                 }
             }
             while (!op_stack.empty())
             {
-                tempChar = op_stack.back();
-                outputPostfix.push_back(tempChar);
+                tempToken = op_stack.back();
+                if (tempToken != LPAREN)
+                    outputPostfix.push_back(tempToken);
                 op_stack.pop_back();
             }
-            strPostfix = outputPostfix;
+            postfix = outputPostfix;
         }
 
         // Using Thompson Alg to construct
+        // 每个运算只新建常数个状态、加常数条边，整体和后缀式长度成线性
         void constructToNFA()
         {
-            std::vector<Fragment *> stack_frag;
-            int stateId = -1;
+            std::vector<Fragment> stack_frag;
+            Fragment frag_start, frag_end;
+            int state_start;
+            int state_end;
 
-            // temp various
-            int i_t;
-            State *state_start;
-            State *state_end;
-            Fragment *frag_start;
-            Fragment *frag_end;
-            Fragment *newFragment;
-
-            for (const char ch : strPostfix)
+            for (const int token : postfix)
             {
-                switch (ch)
+                switch (token)
                 {
-                    case '*':
-                        // closure 遇到*，生成多个运算
-                        // From f2:s2->s3
-                        // to fn:s2-e->s3,s3-a->s3,s3-e->s4
+                    case STAR:
+                        // closure: s-~->f.start, s-~->e, f.end-~->f.start, f.end-~->e
                         frag_end = stack_frag.back();
                         stack_frag.pop_back();
-
-                        frag_end->state_start->transitions_e.push_back(frag_end->state_end);
-
-                        for (std::pair<const char, State *> &pairTemp : frag_end->state_start->transitions)
-                        {
-                            pairTemp.second = frag_end->state_end;
-                            frag_end->state_end->transitions.insert(pairTemp);
-                        }
-                        frag_end->state_start->transitions.clear();
-                        frag_end->state_end->isEnd = false;
-
-                        stateId = getMaxStateID(nfa) + 1;
-                        state_end = new State(stateId, true);
-                        stateId++;
-                        nfa.states.push_back(state_end);
-
-                        frag_end->state_end->transitions_e.push_back(state_end);
-                        frag_end->state_end = state_end;
-
-                        stack_frag.push_back(frag_end);
+                        state_start = nfa.newState();
+                        state_end = nfa.newState();
+                        nfa.addEdge(state_start, EPS, frag_end.state_start);
+                        nfa.addEdge(state_start, EPS, state_end);
+                        nfa.addEdge(frag_end.state_end, EPS, frag_end.state_start);
+                        nfa.addEdge(frag_end.state_end, EPS, state_end);
+                        stack_frag.push_back(Fragment(state_start, state_end));
                         break;
-                    case '|':
-                        // union 遇到或
+                    case PLUS:
+                        // one or more: f.end-~->f.start, f.end-~->e
+                        frag_end = stack_frag.back();
+                        stack_frag.pop_back();
+                        state_end = nfa.newState();
+                        nfa.addEdge(frag_end.state_end, EPS, frag_end.state_start);
+                        nfa.addEdge(frag_end.state_end, EPS, state_end);
+                        stack_frag.push_back(Fragment(frag_end.state_start, state_end));
+                        break;
+                    case QUEST:
+                        // optional: s-~->f.start, s-~->e, f.end-~->e
+                        frag_end = stack_frag.back();
+                        stack_frag.pop_back();
+                        state_start = nfa.newState();
+                        state_end = nfa.newState();
+                        nfa.addEdge(state_start, EPS, frag_end.state_start);
+                        nfa.addEdge(state_start, EPS, state_end);
+                        nfa.addEdge(frag_end.state_end, EPS, state_end);
+                        stack_frag.push_back(Fragment(state_start, state_end));
+                        break;
+                    case ALT:
+                        // union: s-~->f1.start, s-~->f2.start, f1.end-~->e, f2.end-~->e
                         frag_end = stack_frag.back();
                         stack_frag.pop_back();
                         frag_start = stack_frag.back();
                         stack_frag.pop_back();
-
-                        for (std::pair<const char, State *> it : frag_end->state_start->transitions)
-                        {
-                            it.second = frag_start->state_end;
-                            frag_start->state_start->transitions.insert(it);
-                        }
-
-                        nfa.removeState(frag_end->state_start);
-                        nfa.removeState(frag_end->state_end);
-
-                        stateId = getMaxStateID(nfa) + 1;
-
-                        newFragment = new Fragment(frag_start->state_start, frag_start->state_end);
-                        stack_frag.push_back(newFragment);
-                        delete frag_end;
-                        delete frag_start;
+                        state_start = nfa.newState();
+                        state_end = nfa.newState();
+                        nfa.addEdge(state_start, EPS, frag_start.state_start);
+                        nfa.addEdge(state_start, EPS, frag_end.state_start);
+                        nfa.addEdge(frag_start.state_end, EPS, state_end);
+                        nfa.addEdge(frag_end.state_end, EPS, state_end);
+                        stack_frag.push_back(Fragment(state_start, state_end));
                         break;
-                    case DIV_CHAR:
-                        // concat 直接连接两个fragment
-                        // 将 f_s:s1->s2,f_e:s3->s4
-                        // 变成 f_n:s1->s2->s4
+                    case CONCAT:
+                        // concat: f1.end-~->f2.start
                         frag_end = stack_frag.back();
                         stack_frag.pop_back();
                         frag_start = stack_frag.back();
                         stack_frag.pop_back();
+                        nfa.addEdge(frag_start.state_end, EPS, frag_end.state_start);
+                        stack_frag.push_back(Fragment(frag_start.state_start, frag_end.state_end));
+                        break;
+                    case EMPTY:
+                        state_start = nfa.newState();
+                        stack_frag.push_back(Fragment(state_start, state_start));
+                        break;
+                    default:
+                        // 遇到字节或字符类，一条边
+                        state_start = nfa.newState();
+                        state_end = nfa.newState();
+                        nfa.addEdge(state_start, token, state_end);
+                        stack_frag.push_back(Fragment(state_start, state_end));
+                        break;
+                }
+            }
 
-                        frag_start->state_end->transitions = frag_end->state_start->transitions;
-                        frag_start->state_end->transitions_e = frag_end->state_start->transitions_e;
-
-                        // 移除frag_end中的state_start
-                        nfa.removeState(frag_end->state_start);
-
-                        frag_end->state_start = frag_start->state_end;
+            if (stack_frag.empty())
+            {
+                // 空正则只接受空串
+                state_start = nfa.newState();
+                stack_frag.push_back(Fragment(state_start, state_start));
+            }
+            nfa.start = stack_frag.back().state_start;
+            nfa.accept = stack_frag.back().state_end;
+            nfa.finish();
+        }
 
-                        i_t = -1;
-                        for (State *state : nfa.states)
-                        {
-                            state->ID = i_t++;
-                        }
+        // 正则的规范形式：后缀式的各个记号再加上各字符类的内容，写法不同但意思相同的正则
+        // (如a{2}和aa、[a-c]和[abc])规范形式相同，用作编译缓存的键
+        std::string normalized() const
+        {
+            std::string key;
+            for (int token : postfix)
+                key.append((const char *) &token, sizeof(token));
+            for (const std::bitset<256> &set : nfa.sets)
+                key += set.to_string();
+            return key;
+        }
 
-                        stateId = getMaxStateID(nfa) + 1;
-                        newFragment = new Fragment(frag_start->state_start, frag_end->state_end);
-                        stack_frag.push_back(newFragment);
-                        delete frag_end;
-                        delete frag_start;
+        // 由后缀式求每个匹配都必须以之开头的字面前缀，用于查找时跳过不可能开始匹配的位置。
+        // 对每个子表达式求(前缀, 是否恰好只匹配这个字符串)，按后缀式自底向上合并
+        std::string literalPrefix() const
+        {
+            std::vector<std::pair<std::string, bool> > stack;
+            for (int token : postfix)
+            {
+                std::pair<std::string, bool> a, b;
+                if (token == ALT || token == CONCAT)
+                {
+                    b = stack.back();
+                    stack.pop_back();
+                }
+                if (!isOperand(token))
+                {
+                    a = stack.back();
+                    stack.pop_back();
+                }
+                switch (token)
+                {
+                    case CONCAT:
+                        if (a.second)
+                            stack.push_back(std::make_pair(a.first + b.first, b.second));
+                        else
+                            stack.push_back(std::make_pair(a.first, false));
+                        break;
+                    case ALT:
+                    {
+                        std::size_t n = 0;
+                        while (n < a.first.size() && n < b.first.size() && a.first[n] == b.first[n])
+                            n++;
+                        stack.push_back(std::make_pair(a.first.substr(0, n), a.second && b.second && a.first == b.first));
+                        break;
+                    }
+                    case STAR:
+                    case QUEST:
+                        stack.push_back(std::make_pair(std::string(), a.second && a.first.empty()));
+                        break;
+                    case PLUS:
+                        stack.push_back(std::make_pair(a.first, a.second && a.first.empty()));
+                        break;
+                    case EMPTY:
+                        stack.push_back(std::make_pair(std::string(), true));
                         break;
                     default:
-                        // 遇到普通字符
-                        state_start = new State(stateId, false);
-                        stateId++;
-                        state_end = new State(stateId, true);
-                        stateId++;
-                        state_start->transitions[ch] = state_end;
-                        newFragment = new Fragment(state_start, state_end);
-
-                        nfa.states.push_back(state_start);
-                        nfa.states.push_back(state_end);
-
-                        stack_frag.push_back(newFragment);
+                        if (token < 256)
+                            stack.push_back(std::make_pair(std::string(1, char(token)), true));
+                        else
+                            stack.push_back(std::make_pair(std::string(), false));
                         break;
                 }
             }
+            return stack.empty() ? std::string() : stack.back().first;
         }
 
     private:
-        // 检查一个字符是否在字符串里面
-        static bool isCharInStr(const std::string &s, const char c)
+        static bool isOperand(int token)
         {
-            std::size_t idx;
-            idx = s.find(c);
-            if (idx != std::string::npos)
-            {
-                return true;
-            } else
-            {
-                return false;
-            }
+            return token >= 0 || token == EMPTY;
         }
 
-        static int getMaxStateID(const NFA &nfa)
+        static int hexValue(char c)
         {
-            int maxState = -1;
-            for (const State *state : nfa.states)
-            {
-                maxState = (maxState > state->ID) ? maxState : state->ID;
-            }
-            return maxState;
+            if (c >= '0' && c <= '9')
+                return c - '0';
+            if (c >= 'a' && c <= 'f')
+                return c - 'a' + 10;
+            if (c >= 'A' && c <= 'F')
+                return c - 'A' + 10;
+            return -1;
         }
 
-        // 检查变量
-    public:
-        void printInputByChar()
+        // 读input[i]开始的一个转义(i指向'\')，结果并入set，next为转义之后的位置
+        void parseEscape(std::size_t i, std::size_t &next, std::bitset<256> &set) const
         {
-            std::cout << "This is input: ";
-            for (char i : input)
+            next = i + 2;
+            if (i + 1 >= input.length())
             {
-                std::cout << i;
+                set.set('\\');
+                next = i + 1;
+                return;
             }
-            std::cout << std::endl;
+            char c = input[i + 1];
+            std::bitset<256> cls;
+            switch (c)
+            {
+                case 'n':
+                    set.set('\n');
+                    return;
+                case 't':
+                    set.set('\t');
+                    return;
+                case 'r':
+                    set.set('\r');
+                    return;
+                case 'f':
+                    set.set('\f');
+                    return;
+                case 'v':
+                    set.set('\v');
+                    return;
+                case 'x':
+                    if (i + 3 < input.length() && hexValue(input[i + 2]) >= 0 && hexValue(input[i + 3]) >= 0)
+                    {
+                        set.set(hexValue(input[i + 2]) * 16 + hexValue(input[i + 3]));
+                        next = i + 4;
+                    } else
+                        set.set('x');
+                    return;
+                case 'd':
+                case 'D':
+                    for (int b = '0'; b <= '9'; b++)
+                        cls.set(b);
+                    break;
+                case 'w':
+                case 'W':
+                    for (int b = 0; b < 256; b++)
+                        if (isalnum(b) || b == '_')
+                            cls.set(b);
+                    break;
+                case 's':
+                case 'S':
+                    for (const char *p = " \t\n\r\f\v"; *p; p++)
+                        cls.set((unsigned char) *p);
+                    break;
+                default:
+                    set.set((unsigned char) c);
+                    return;
+            }
+            set |= isupper((unsigned char) c) ? ~cls : cls;
         }
 
-        void printInsertStrByChar()
+        // 读input[i]开始的一个操作数：字面字符、转义、'.'或[...]，返回记号
+        int parseAtom(std::size_t i, std::size_t &next)
         {
-            std::cout << "This is inserted: ";
-            for (char i : strBeInsert)
+            std::bitset<256> set;
+            char ch = input[i];
+            next = i + 1;
+            if (ch != '.' && ch != '\\' && ch != '[')
+                return (unsigned char) ch;
+            if (ch == '.')
             {
-                std::cout << i;
+                set.set();
+                set.reset('\n');
+            } else if (ch == '\\')
+                parseEscape(i, next, set);
+            else if (ch == '[')
+            {
+                std::size_t j = i + 1;
+                bool negate = j < input.length() && input[j] == '^';
+                if (negate)
+                    j++;
+                // 紧跟在'['或'[^'后面的']'是字面字符
+                bool first = true;
+                while (j < input.length() && (first || input[j] != ']'))
+                {
+                    first = false;
+                    std::bitset<256> one;
+                    std::size_t after = j + 1;
+                    if (input[j] == '\\')
+                        parseEscape(j, after, one);
+                    else
+                        one.set((unsigned char) input[j]);
+                    // a-z这样的范围，'-'在开头或结尾时是字面字符
+                    if (one.count() == 1 && after + 1 < input.length() && input[after] == '-' &&
+                        input[after + 1] != ']')
+                    {
+                        int low = 0;
+                        while (!one.test(low))
+                            low++;
+                        std::bitset<256> upper;
+                        std::size_t end = after + 2;
+                        if (input[after + 1] == '\\')
+                            parseEscape(after + 1, end, upper);
+                        else
+                            upper.set((unsigned char) input[after + 1]);
+                        if (upper.count() == 1)
+                        {
+                            int high = 0;
+                            while (!upper.test(high))
+                                high++;
+                            for (int b = low; b <= high; b++)
+                                one.set(b);
+                            after = end;
+                        }
+                    }
+                    set |= one;
+                    j = after;
+                }
+                if (negate)
+                    set.flip();
+                next = j < input.length() ? j + 1 : j;
             }
-            std::cout << std::endl;
-        }
 
-        void printPostfixStrByChar()
-        {
-            printf("This is postfix: ");
-            for (char i : strPostfix)
+            if (set.count() == 1)
             {
-                std::cout << i;
+                int c = 0;
+                while (!set.test(c))
+                    c++;
+                return c;
             }
-            std::cout << std::endl;
+            return nfa.addSet(set);
         }
-    };
-
-    void regex2nfa()
-    {
-        std::cout << "Please enter the regex:";
-
-        regex2nfa::Regex2Nfa regex2nfa;
+
+        // input[i]为'{'时读重复次数{m}、{m,}、{,n}或{m,n}，把raw中从atom开始的操作数展开成
+        // m个必选加(n-m)个可选的拷贝，{m,}为m个必选再加一个*。格式不对时返回false，'{'按字面处理；
+        // 展开后超过MAX_TOKENS时设置error，raw不变
+        bool parseRepeat(std::size_t i, std::size_t &next, std::size_t atom, std::vector<int> &raw)
+        {
+            std::size_t j = i + 1;
+            int low = 0, high = 0;
+            bool digits = false, unbounded = false;
+            while (j < input.length() && isdigit((unsigned char) input[j]))
+            {
+                low = std::min(low * 10 + (input[j++] - '0'), 100000);
+                digits = true;
+            }
+            high = low;
+            if (j < input.length() && input[j] == ',')
+            {
+                j++;
+                unbounded = true;
+                if (j < input.length() && isdigit((unsigned char) input[j]))
+                {
+                    unbounded = false;
+                    digits = true;
+                    high = 0;
+                    while (j < input.length() && isdigit((unsigned char) input[j]))
+                        high = std::min(high * 10 + (input[j++] - '0'), 100000);
+                }
+            }
+            if (!digits || j >= input.length() || input[j] != '}' || high < low)
+                return false;
+            if (atom >= raw.size() || raw.back() == ALT || raw.back() == LPAREN)
+                return false;
+            next = j + 1;
+
+            //展开后的长度：low份必选，再加1份带*或(high-low)份各带一个?
+            std::size_t unitSize = raw.size() - atom;
+            std::size_t copies = unbounded ? low + 1 : high;
+            std::size_t total = atom + copies * unitSize + (unbounded ? 1 : high - low) + 1;
+            if (total > MAX_TOKENS)
+            {
+                error = "repeat " + input.substr(i, next - i) + " expands to more than " +
+                        std::to_string(MAX_TOKENS) + " tokens";
+                return true;
+            }
+
+            std::vector<int> unit(raw.begin() + atom, raw.end());
+            raw.resize(atom);
+            for (int k = 0; k < low; k++)
+                raw.insert(raw.end(), unit.begin(), unit.end());
+            if (unbounded)
+            {
+                raw.insert(raw.end(), unit.begin(), unit.end());
+                raw.push_back(STAR);
+            } else
+            {
+                for (int k = low; k < high; k++)
+                {
+                    raw.insert(raw.end(), unit.begin(), unit.end());
+                    raw.push_back(QUEST);
+                }
+            }
+            if (low == 0 && high == 0 && !unbounded)
+                raw.push_back(EMPTY);
+            return true;
+        }
+
+        // 边上符号的文本形式，~边写成~，字符类展开成其中的每个字节
+        std::vector<std::string> symbolNames(int symbol) const
+        {
+            std::vector<std::string> names;
+            if (symbol == EPS)
+                names.push_back(std::string(1, '~'));
+            else
+            {
+                for (int c = 0; c < 256; c++)
+                {
+                    if (nfa.matches(symbol, c))
+                        names.push_back(std::string(1, char(c)));
+                }
+            }
+            return names;
+        }
+
+        // 记号的文本形式
+        static std::string tokenName(int token)
+        {
+            switch (token)
+            {
+                case CONCAT:
+                    return "_";
+                case ALT:
+                    return "|";
+                case STAR:
+                    return "*";
+                case PLUS:
+                    return "+";
+                case QUEST:
+                    return "?";
+                case LPAREN:
+                    return "(";
+                case RPAREN:
+                    return ")";
+                case EMPTY:
+                    return "()";
+                default:
+                    return token < 256 ? std::string(1, char(token)) : "[" + std::to_string(token - 256) + "]";
+            }
+        }
+
+        // 检查变量
+    public:
+        void printInputByChar()
+        {
+            std::cout << "This is input: ";
+            for (char i : input)
+            {
+                std::cout << i;
+            }
+            std::cout << std::endl;
+        }
+
+        void printInsertStrByChar()
+        {
+            std::cout << "This is inserted: ";
+            for (int i : tokens)
+            {
+                std::cout << tokenName(i);
+            }
+            std::cout << std::endl;
+        }
+
+        void printPostfixStrByChar()
+        {
+            printf("This is postfix: ");
+            for (int i : postfix)
+            {
+                std::cout << tokenName(i);
+            }
+            std::cout << std::endl;
+        }
+    };
+
+    void regex2nfa()
+    {
+        std::cout << "Please enter the regex:";
+
+        regex2nfa::Regex2Nfa regex2nfa;
 
         // get regex expression,eg: (a|b)*c,abed
 //    regex2nfa.setInput("(a|b)*abb");
@@ -672,7 +934,11 @@ namespace regex2nfa
         //    regex2nfa.setInput("abb");
 
         // [Treat]Insert explicit concatenation operator,(a|b)*c -> (a|b)*_c
-        regex2nfa.insertExplicit();
+        if (!regex2nfa.insertExplicit())
+        {
+            std::cerr << "regex error: " << regex2nfa.getError() << '\n';
+            return;
+        }
 
         // [Treat]Convert to postfix notation, (a|b)*_c -> ab|*c
         regex2nfa.convertToPostfix();
@@ -702,440 +968,489 @@ namespace nfa2dfa
 {
     struct trans
     {
-        char start; //转换初态
+        int start; //转换初态
         char receive; //接受的字母
-        char end; //转换的结果
+        int end; //转换的结果
     };
 
     struct NFA
     {
-        std::set<char> state; //状态集，默认X初态，Y终态不单独列出
+        std::set<int> state; //状态集
         std::set<char> word;  //字母表 空字母~不放进去
         std::vector<struct trans> transfunc; //状态转换函数
+        int start = 0;  //初态
+        int accept = 0; //终态
+        std::map<int, int> tags; //多条规则合成的NFA中各规则的终态 -> 规则编号，不为空时代替accept
+        char epsilon = '~';      //~边用的字母，'~'本身是某个等价类的代表字母时换成别的字节
+        std::vector<int> represent; //256项，字节 -> 所在等价类在transfunc里的代表字母，-1为没有边；
+                                    //为空时transfunc里的字母就是字节本身
     };
 
     struct DFA
     {
-        std::set<char> state; //状态集，默认X初态，Y终态不单独列出
+        std::set<int> state; //状态集，编号为0..n-1
         std::set<char> word;  //字母表 空字母~不放进去
-        std::vector<struct trans> transfunc; //状态转换函数
+        std::vector<struct trans> transfunc; //状态转换函数，按start升序
+        int start = 0;         //初态
+        std::set<int> accept;  //终态集合，可以有多个
+        std::map<int, int> tag; //NFA有tags时，终态 -> 规则编号
+        std::vector<unsigned char> byteClass;  //256项，字节 -> 等价类，0类为字母表以外的字节
+        int classes = 1;                       //等价类个数，含0类
+        std::vector<int> table;                //table[state*classes+类]，-1为没有边
     };
 
-    // NFA输入，NFAM用来储存
-
-    void input(struct NFA &NFAM)
+    // tmp_*.txt中自动机的文本格式，状态名为任意整数，一行一个状态：
+    // X 0              初态
+    // Y 3 5            终态，可以有多个
+    // 0 0-a->1 0-b->0  状态及其发出的边
+    bool parseEdge(const std::string &token, struct trans &temptrans)
     {
+        std::size_t arrow = token.rfind("->");
+        if (arrow == std::string::npos || arrow < 3 || token[arrow - 2] != '-')
+            return false;
+        temptrans.start = std::atoi(token.substr(0, arrow - 2).c_str());
+        temptrans.receive = token[arrow - 1];
+        temptrans.end = std::atoi(token.substr(arrow + 2).c_str());
+        return true;
+    }
 
-        int newend = 0; //0表示没新状态产生
-        char tempChar;
-        int all_have_vex = 1;//1表示每个中间状态都发出了弧，也就是在输入过程中作为NFA的state出现过
-        FILE *fin = fopen("tmp_nfa_orign.txt", "r");
-        std::map<char, int> statemarked = {}; //value=0表示状态没有发出的弧
-
-        char state; //状态  每行输入开头的状态
-        struct trans temptrans;// 临时存储输入的转换规则
-
-        // 输入流设为文件
-//        freopen("tmp_nfa_orign.txt","r",stdin);
-
-        //大行输入
-        while (1)
+    void readAutomaton(std::istream &is, int &start, std::set<int> &accept,
+                       std::set<int> &state, std::vector<struct trans> &transfunc)
+    {
+        std::string line, token;
+        while (getline(is, line))
         {
-
-            fscanf(fin, "%c", &state);
-            fscanf(fin, "%c", &tempChar);
-            NFAM.state.insert(state);//状态插入到集合中
-            //如果曾经出现过state状态，则对其标记
-            if (statemarked.count(state))
-                statemarked[state] = 1;
-            //行内转换规则输入
-            newend = 0;//0表示没新状态产生
-            all_have_vex = 1;//1是默认状态，表示每个中间状态都发出了弧
-            while (1)
+            std::istringstream in(line);
+            if (!(in >> token))
+                continue;
+            if (token == "X")
             {
-
-                if (state == 'Y')
+                in >> start;
+                state.insert(start);
+            } else if (token == "Y")
+            {
+                int s;
+                while (in >> s)
                 {
-                    //Y的情况是转换规则接受一个空格然后换行
-                    //getchar();//取走空格
-                    fscanf(fin, "%c", &tempChar);
-                    if (tempChar == '\n')
-                    {//取换行并判断转换规则输入结束
-                        break;
-                    }
-                    //break;
+                    accept.insert(s);
+                    state.insert(s);
                 }
-                //普通输入情况
-                fscanf(fin, "%c-%c->%c", &temptrans.start, &temptrans.receive, &temptrans.end);
-                NFAM.word.insert(temptrans.receive);//添加字母表
-                NFAM.transfunc.push_back(temptrans);//添加转换规则
-                //判断有无新状态end产生
-                if (NFAM.state.count(temptrans.end) == 0)
+            } else
+            {
+                struct trans temptrans;
+                state.insert(std::atoi(token.c_str()));
+                while (in >> token)
                 {
-                    //等于0表示之前没这个状态，代表有新状态产生
-                    newend = 1;
-                    //新状态添加到statemarked中 新状态仅包含0，1，2，3等，不含初态终态
-                    if (temptrans.end != 'Y')
-                        statemarked[temptrans.end] = 0;
+                    if (!parseEdge(token, temptrans))
+                        continue;
+                    state.insert(temptrans.end);
+                    transfunc.push_back(temptrans);
                 }
+            }
+        }
+    }
+
+    bool ASC(trans i, trans j)
+    {
+        return (i.start < j.start);
+    }//升序 给std::stable_sort用
 
-                fscanf(fin, "%c", &tempChar);
-                if (tempChar == '\n')
+    void writeAutomaton(std::ostream &os, int start, const std::set<int> &accept,
+                        const std::set<int> &state, std::vector<struct trans> transfunc)
+    {
+        std::stable_sort(transfunc.begin(), transfunc.end(), ASC);
+        os << "X " << start << std::endl;
+        os << "Y";
+        for (int s : accept)
+            os << ' ' << s;
+        os << std::endl;
+
+        std::vector<struct trans>::const_iterator it = transfunc.begin();
+        for (int s : state)
+        {
+            os << s;
+            while (it != transfunc.end() && it->start < s)
+                it++;
+            for (; it != transfunc.end() && it->start == s; it++)
+                os << ' ' << it->start << '-' << it->receive << "->" << it->end;
+            os << std::endl;
+        }
+    }
+
+    // NFA输入，NFAM用来储存
+    void input(struct NFA &NFAM)
+    {
+        std::ifstream inf("tmp_nfa_orign.txt");
+        std::set<int> accept;
+        readAutomaton(inf, NFAM.start, accept, NFAM.state, NFAM.transfunc);
+        if (!accept.empty())
+            NFAM.accept = *accept.begin();
+        for (const struct trans &t : NFAM.transfunc)
+            NFAM.word.insert(t.receive);
+        inf.close();
+    }
+
+
+    // 直接从regex2nfa的NFA结构读入，状态名即状态编号。
+    // 字符类不按字节展开：先求出字节等价类，每个类取最小的字节作代表字母，
+    // 一条字符类的边只对它覆盖的每个类各出一条边；字节到代表字母的对应放在represent里
+    void input(const regex2nfa::NFA &nfa, struct NFA &NFAM)
+    {
+        NFAM.start = nfa.start;
+        NFAM.accept = nfa.accept;
+
+        std::vector<unsigned char> byteClass;
+        int classes = nfa.byteClasses(byteClass);
+        std::vector<int> label(classes, -1);
+        for (int c = 255; c >= 0; c--)
+            label[byteClass[c]] = c;
+        NFAM.represent.assign(256, -1);
+        for (int c = 0; c < 256; c++)
+        {
+            if (byteClass[c] != 0)
+                NFAM.represent[c] = label[byteClass[c]];
+        }
+        if (std::count(label.begin() + 1, label.end(), '~'))
+        {
+            //'~'是代表字母，~边换成一个不是代表字母的字节
+            for (int c = 0; c < 256; c++)
+            {
+                if (std::find(label.begin() + 1, label.end(), c) == label.end())
                 {
+                    NFAM.epsilon = char(c);
                     break;
                 }
             }
+        }
 
-            //看所有状态是否都发出了弧
-            std::map<char, int>::iterator it;
-            for (it = statemarked.begin(); it != statemarked.end(); it++)
+        struct trans temptrans;
+        for (int state = 0; state < nfa.stateCount; state++)
+        {
+            NFAM.state.insert(state);
+            temptrans.start = state;
+            for (const regex2nfa::Edge *e = nfa.edgeBegin(state); e != nfa.edgeEnd(state); e++)
             {
-                if ((*it).second == 0)
+                temptrans.end = e->target;
+                if (e->symbol == regex2nfa::EPS)
                 {
-                    //0表示没发出弧
-                    all_have_vex = 0;
+                    temptrans.receive = NFAM.epsilon;
+                    NFAM.transfunc.push_back(temptrans);
+                    continue;
                 }
-            }
-
-            //判断有无新状态产生
-            if (newend == 0 && state != 'Y')
-            {
-                //无新状态产生且不是终态Y
-                //如果statemarked中的所有状态都发出了弧，既value都为1则break
-                if (all_have_vex == 1)
+                for (int k = 1; k < classes; k++)
                 {
-                    break;
+                    if (e->symbol < 0 || (e->symbol < 256 ? k != byteClass[e->symbol] : !nfa.matches(e->symbol, label[k])))
+                        continue;
+                    temptrans.receive = char(label[k]);
+                    NFAM.word.insert(temptrans.receive);
+                    NFAM.transfunc.push_back(temptrans);
                 }
             }
-            //getchar();//再取走一个换行
         }
+    }
 
+    // 字节等价类：在transfunc中边完全相同的字母归为一类，其余字节(包括~边的字母epsilon)都是0类，
+    // 同一类的字母在NFA里处处走向相同，在由它构造出的DFA里也一样；返回类的个数(含0类)
+    int byteClasses(const std::vector<struct trans> &transfunc, std::vector<unsigned char> &byteClass,
+                    char epsilon = '~')
+    {
+        std::map<char, std::vector<std::pair<int, int> > > column;
+        for (const struct trans &t : transfunc)
+        {
+            if (t.receive != epsilon)
+                column[t.receive].push_back(std::make_pair(t.start, t.end));
+        }
+        std::map<std::vector<std::pair<int, int> >, int> classOf;
+        byteClass.assign(256, 0);
+        for (std::pair<const char, std::vector<std::pair<int, int> > > &c : column)
+        {
+            std::sort(c.second.begin(), c.second.end());
+            c.second.erase(std::unique(c.second.begin(), c.second.end()), c.second.end());
+            int id = classOf.size() + 1;
+            byteClass[(unsigned char) c.first] = classOf.insert(std::make_pair(c.second, id)).first->second;
+        }
+        return classOf.size() + 1;
     }
 
+    // 子集构造用的NFA：状态稠密编号为0..n-1，每个状态的~边和字母边各自成表，
+    // 状态集合用位集合表示，第i位为1表示包含第i个状态
+    typedef std::vector<unsigned long long> StateSet;
 
-    //求集合的ε-closure状态子集 此集合包含I自身
-    std::set<char> closure(std::set<char> I, struct NFA NFAM)
+    struct StateSetHash
     {
-        std::set<char> closureset = I;//最后的结果储存,现把自身都放进去
-
-        //对集合I每个状态遍历，找到其所能到达的点
-        for (std::set<char>::iterator it = I.begin(); it != I.end(); it++)
+        std::size_t operator()(const StateSet &set) const
         {
-            //遍历vector，找到集合I中状态经~所能到达的状态，并加入closureset中
-            int count = NFAM.transfunc.size();
-            for (int i = 0; i < count; i++)
+            unsigned long long h = 14695981039346656037ULL;
+            for (unsigned long long w : set)
             {
-
-                //修改判定条件NFAM.transfunc[i].start要在closureset中！！！！！！！！！！
-                if (closureset.count(NFAM.transfunc[i].start) == 1 && NFAM.transfunc[i].receive == '~')
-                {
-                    closureset.insert(NFAM.transfunc[i].end);
-                }
+                h = (h ^ w) * 1099511628211ULL;
             }
+            return h;
         }
-        return closureset;
-    }
+    };
 
-    //求状态集合I经弧a或b或...到达的集合  只包含能到达的状态，不包含自身
-    std::set<char> state_word_move(std::set<char> I, char receive, struct NFA NFAM)
+    //子集构造用的哈希表只存状态集在I中的下标，哈希和比较时再取I中的状态集，每个状态集只存一份
+    struct SubsetHash
     {
-        std::set<char> wordmove_set;//最后的结果
+        const std::vector<StateSet> *sets;
 
-        //对集合I每个状态遍历，找到其收到word所能到达的点
-        for (std::set<char>::iterator it = I.begin(); it != I.end(); it++)
+        std::size_t operator()(int i) const
         {
-            //遍历vector，找到集合I中状态经~所能到达的状态，并加入closureset中
-            int count = NFAM.transfunc.size();
-            for (int i = 0; i < count; i++)
-            {
-                if (NFAM.transfunc[i].start == (*it) && NFAM.transfunc[i].receive == receive)
-                {
-                    wordmove_set.insert(NFAM.transfunc[i].end);
-                }
-            }
+            return StateSetHash()((*sets)[i]);
         }
-        return wordmove_set;
-    }
+    };
 
-    //状态集重命名
-    std::map<std::set<char>, char> rename(std::vector<std::set<char>> I)
+    struct SubsetEqual
     {
-        std::map<std::set<char>, char> rename_table;
-        for (unsigned int i = 0; i < I.size(); i++)
+        const std::vector<StateSet> *sets;
+
+        bool operator()(int a, int b) const
         {
-            if (i == 0)
-            {
-                rename_table[I[i]] = 'X';
-            } else if (i == I.size() - 1)
-            {
-                rename_table[I[i]] = 'Y';
-            } else
-            {
-                if (!I[i].empty())
-                    rename_table[I[i]] = '0' + i - 1;
-            }
+            return (*sets)[a] == (*sets)[b];
         }
+    };
 
-        return rename_table;
-    }
-
-    bool ASC(trans i, trans j)
+    struct DenseNFA
     {
-        return (i.start < j.start);
-    }//升序 给std::sort用
-    bool DESC(trans i, trans j)
+        std::vector<int> name;                       // 编号 -> 状态名
+        std::map<int, int> id;                       // 状态名 -> 编号
+        std::vector<char> word;                      // word[k]为第k+1个等价类的代表字母
+        std::vector<unsigned char> byteClass;        // transfunc里的字母 -> 等价类，见byteClasses()
+        std::vector<int> epsOffset;                  // CSR：状态s的~边为eps[epsOffset[s]..epsOffset[s+1])
+        std::vector<int> eps;
+        std::vector<int> moveOffset;                 // CSR：状态s的字母边为move[moveOffset[s]..moveOffset[s+1])
+        std::vector<std::pair<int, int>> move;       // (等价类-1, 终点)
+        std::size_t words = 0;                       // 一个位集合有几个unsigned long long
+    };
+
+    DenseNFA densify(const struct NFA &NFAM)
     {
-        return (i.start > j.start);
-    }//降序 给std::sort用
+        DenseNFA dense;
+        auto number = [&dense](int state) -> int
+        {
+            std::map<int, int>::iterator it = dense.id.find(state);
+            if (it != dense.id.end())
+                return it->second;
+            dense.id[state] = dense.name.size();
+            dense.name.push_back(state);
+            return dense.name.size() - 1;
+        };
+
+        for (int state : NFAM.state)
+            number(state);
+        for (const trans &t : NFAM.transfunc)
+        {
+            number(t.start);
+            number(t.end);
+        }
+        dense.word.resize(byteClasses(NFAM.transfunc, dense.byteClass, NFAM.epsilon) - 1);
+        for (char w : NFAM.word)
+        {
+            if (dense.byteClass[(unsigned char) w] != 0)
+                dense.word[dense.byteClass[(unsigned char) w] - 1] = w;
+        }
+
+        //按起点计数排序成CSR
+        std::size_t n = dense.name.size();
+        dense.epsOffset.assign(n + 1, 0);
+        dense.moveOffset.assign(n + 1, 0);
+        for (const trans &t : NFAM.transfunc)
+        {
+            if (t.receive == NFAM.epsilon)
+                dense.epsOffset[dense.id[t.start] + 1]++;
+            else
+                dense.moveOffset[dense.id[t.start] + 1]++;
+        }
+        for (std::size_t i = 0; i < n; i++)
+        {
+            dense.epsOffset[i + 1] += dense.epsOffset[i];
+            dense.moveOffset[i + 1] += dense.moveOffset[i];
+        }
+        dense.eps.resize(dense.epsOffset[n]);
+        dense.move.resize(dense.moveOffset[n]);
+        std::vector<int> epsFill(dense.epsOffset.begin(), dense.epsOffset.end() - 1);
+        std::vector<int> moveFill(dense.moveOffset.begin(), dense.moveOffset.end() - 1);
+        for (const trans &t : NFAM.transfunc)
+        {
+            int from = dense.id[t.start];
+            if (t.receive == NFAM.epsilon)
+                dense.eps[epsFill[from]++] = dense.id[t.end];
+            else
+                dense.move[moveFill[from]++] = std::make_pair(dense.byteClass[(unsigned char) t.receive] - 1,
+                                                              dense.id[t.end]);
+        }
+        dense.words = (dense.name.size() + 63) / 64;
+        return dense;
+    }
 
-    void resort_trans(struct DFA &DFAM)
+    //求集合的ε-closure，结果包含集合自身，直接在set上扩充
+    void closure(StateSet &set, const DenseNFA &dense, std::vector<int> &stack)
     {
-        //XX 00 11 22 YY
-        //X 0 Y
-        sort(DFAM.transfunc.begin(), DFAM.transfunc.end(), DESC);//这步结束时 X,Y,2,1,0,目的是把X,Y放最前面
-        //循环找到第一个数字start状态
-        unsigned int index = 0;
-        for (index = 0; index < DFAM.transfunc.size(); index++)
+        stack.clear();
+        for (std::size_t w = 0; w < set.size(); w++)
         {
-            if (DFAM.transfunc[index].start < 'X')
+            for (unsigned long long bits = set[w]; bits; bits &= bits - 1)
+                stack.push_back(w * 64 + __builtin_ctzll(bits));
+        }
+        while (!stack.empty())
+        {
+            int state = stack.back();
+            stack.pop_back();
+            for (int e = dense.epsOffset[state]; e < dense.epsOffset[state + 1]; e++)
             {
-                break;
+                int next = dense.eps[e];
+                if (!(set[next / 64] >> (next % 64) & 1))
+                {
+                    set[next / 64] |= 1ULL << (next % 64);
+                    stack.push_back(next);
+                }
             }
         }
+    }
 
-        // XY 排序
-        sort(DFAM.transfunc.begin(), DFAM.transfunc.begin() + index, ASC);//这步结束时 X,Y,0,1,2
-        // 数字排序
-        sort(DFAM.transfunc.begin() + index, DFAM.transfunc.end(), ASC);//这步结束时 X,Y,0,1,2
+    //一次求出集合I经每个等价类到达的集合，moves[k]对应第k+1类，不含I自身
+    void state_word_move(const StateSet &I, const DenseNFA &dense, std::vector<StateSet> &moves)
+    {
+        moves.assign(dense.word.size(), StateSet(dense.words, 0));
+        for (std::size_t w = 0; w < I.size(); w++)
+        {
+            for (unsigned long long bits = I[w]; bits; bits &= bits - 1)
+            {
+                int state = w * 64 + __builtin_ctzll(bits);
+                for (int e = dense.moveOffset[state]; e < dense.moveOffset[state + 1]; e++)
+                    moves[dense.move[e].first][dense.move[e].second / 64] |= 1ULL << (dense.move[e].second % 64);
+            }
+        }
     }
 
 
     //NFA 转 DFA
-    DFA NFAtoDFA(struct NFA NFAM)
+    //子集按发现顺序编号为0..n-1，0为初态，含NFA终态的子集都是终态；
+    //NFA带规则标记时，子集的规则取其中编号最小的规则，即先写的规则优先
+    //子集构造按字节等价类进行，结果同时存为[状态][等价类]的table和逐字母展开的transfunc
+    DFA NFAtoDFA(const struct NFA &NFAM)
     {
+        DenseNFA dense = densify(NFAM);
 
-        //int wordnum;//字母数量，除了空字符
-        //wordnum = NFAM.word.size() - 1;
-
-        std::vector<std::set<char>> I;//初状态集
-        std::queue<std::set<char>> new_state_set;//产生的新状态，保存在队列中，每个循环取出第一个新状态放在vector  I中
-        std::vector<std::set<char>> old_state_set;//旧的状态集，new_state_set每次用完一个状态集，就放到old_state_set中，后面产生的状态集在old_state_set
-        //中查询是否为新状态集   这里用vector存储而不用queue是因为队列不能遍历
-
-        std::map<std::set<char>, char> rename_table;//重命名字典，每个集合对应一个新状态名
+        std::vector<StateSet> I;                                 //发现的状态集，下标即DFA状态编号
+        std::unordered_set<int, SubsetHash, SubsetEqual> index(16, SubsetHash{&I}, SubsetEqual{&I}); //I中各状态集的下标
+        std::vector<std::vector<int>> table;                     //table[i][k]: 状态i经第k+1类到达的状态，-1为空集
+        std::vector<StateSet> moves;
+        std::vector<int> stack;
 
         struct DFA DFAM;//最后的转化结果
 
-        //转换表的存储模型
-        //vector              map
-        //                    key
-        //  I             a     b     c
-        //{X,1,2}       {1,2} {1,2} {1,2}
-        //{1,2}         {1,2} {1,2} {1,2}
-
         //求出初态
-        I.push_back(closure({'X'}, NFAM));
-
-        //遍历字母表（不包含~），建立map，map的key为word，value为vector，vector存放set
-        // key         a   b   c...
-        // value     {1,2}
-        //           {3,4}
-        //            ...
-        //在此处给map的value插入第一组set，相当于构建了状态集表的第一行
-        std::map<char, std::vector<std::set<char>>> word_move_map;
-        for (std::set<char>::iterator it = NFAM.word.begin(); it != NFAM.word.end(); it++)
+        StateSet start(dense.words, 0);
+        if (dense.id.count(NFAM.start))
+            start[dense.id[NFAM.start] / 64] |= 1ULL << (dense.id[NFAM.start] % 64);
+        closure(start, dense, stack);
+        I.push_back(start);
+        index.insert(0);
+
+        //按发现顺序逐个处理，I同时充当队列
+        for (std::size_t i = 0; i < I.size(); i++)
         {
-            if (*it == '~')
-            {
-                continue;
-            }
-            std::set<char> tempset;
-            tempset = state_word_move(I[0], *it, NFAM);
-            tempset = closure(tempset, NFAM);
-            word_move_map[*it].push_back(tempset);
-
-            std::set<char> differ_tempset1;
-            std::set<char> differ_tempset2;
-            set_difference(tempset.begin(), tempset.end(), I[0].begin(), I[0].end(),
-                           inserter(differ_tempset1, differ_tempset1.begin()));
-            set_difference(I[0].begin(), I[0].end(),tempset.begin(), tempset.end(),
-                           inserter(differ_tempset2, differ_tempset2.begin()));
-            //集合非空且不和初态相同
-            if (!tempset.empty() && (!differ_tempset1.empty()||!differ_tempset2.empty()))
+            state_word_move(I[i], dense, moves);
+            table.push_back(std::vector<int>(dense.word.size(), -1));
+            for (std::size_t k = 0; k < moves.size(); k++)
             {
-                new_state_set.push(tempset);//新状态集放在队列中
+                bool empty = true;
+                for (unsigned long long w : moves[k])
+                    empty = empty && w == 0;
+                if (empty)
+                    continue;
+                closure(moves[k], dense, stack);
+                //先放到I的末尾再查，已经有了就撤掉；moves下一轮会重新求，可以直接移走
+                I.push_back(std::move(moves[k]));
+                std::pair<std::unordered_set<int, SubsetHash, SubsetEqual>::iterator, bool> found =
+                    index.insert((int) I.size() - 1);
+                if (!found.second)
+                    I.pop_back();
+                table[i][k] = *found.first;
             }
         }
 
-        //正式开始对状态集表进行处理
-        while (new_state_set.size() != 0)
+        //转化为DFA
+        int accept = dense.id.count(NFAM.accept) ? dense.id[NFAM.accept] : -1;
+        std::vector<std::pair<int, int> > tagged; //(规则编号, NFA状态编号)，按规则编号升序
+        for (const std::pair<const int, int> &t : NFAM.tags)
+        {
+            if (dense.id.count(t.first))
+                tagged.push_back(std::make_pair(t.second, dense.id[t.first]));
+        }
+        std::sort(tagged.begin(), tagged.end());
+        //NFA里边不同的类在DFA里也可能每一列都相同，再合并一次
+        std::map<std::vector<int>, int> columnClass;
+        std::vector<int> merged(dense.word.size() + 1, 0);
+        for (std::size_t k = 0; k < dense.word.size(); k++)
         {
-            std::set<char> newpop_tempset;//临时集合，用来存放new队列中pop出来的集合
-            newpop_tempset = new_state_set.front();
-            new_state_set.pop();//pop没有返回值，所以先用front接受即将pop出的集合
-            I.push_back(newpop_tempset);//用tempset作为初状态集I
+            std::vector<int> column(I.size());
+            for (std::size_t i = 0; i < I.size(); i++)
+                column[i] = table[i][k];
+            int id = columnClass.size() + 1;
+            merged[k + 1] = columnClass.insert(std::make_pair(column, id)).first->second;
+        }
 
-            //作为初态集后就立即添加到old_state_set中表示状态已经用过
-            old_state_set.push_back(newpop_tempset);
-            //在循环中求出通过每个字母产生的集合
-            for (std::set<char>::iterator it = NFAM.word.begin(); it != NFAM.word.end(); it++)
+        DFAM.start = 0;
+        DFAM.classes = columnClass.size() + 1;
+        DFAM.byteClass.resize(256);
+        for (int c = 0; c < 256; c++)
+        {
+            int w = NFAM.represent.empty() ? c : NFAM.represent[c];
+            DFAM.byteClass[c] = w < 0 ? 0 : merged[dense.byteClass[w]];
+        }
+        DFAM.table.assign(I.size() * DFAM.classes, -1);
+        for (char w : NFAM.word)
+        {
+            if (dense.byteClass[(unsigned char) w] != 0)
+                DFAM.word.insert(w);
+        }
+        for (std::size_t i = 0; i < I.size(); i++)
+        {
+            DFAM.state.insert(i);
+            if (NFAM.tags.empty() && accept >= 0 && (I[i][accept / 64] >> (accept % 64) & 1))
+                DFAM.accept.insert(i);
+            for (const std::pair<int, int> &t : tagged)
             {
-                if (*it == '~')
-                {
-                    continue;
-                }
-                std::set<char> tempset;
-                tempset = state_word_move(newpop_tempset, *it, NFAM);
-                tempset = closure(tempset, NFAM);
-                //放到map中
-                word_move_map[*it].push_back(tempset);
-
-                //在old_state_set中对比，看tempset是不是新状态集，是则放进new_state_set队列中
-                int is_new_state = 1;//是否是新集合
-                for (unsigned int i = 0; i < old_state_set.size(); i++)
-                {
-                    std::set<char> differ_tempset;
-                    set_difference(tempset.begin(), tempset.end(), old_state_set[i].begin(), old_state_set[i].end(),
-                                   inserter(differ_tempset, differ_tempset.begin()));
-                    //后一个条件防止是子集的情况发生
-                    if (differ_tempset.size() == 0 && tempset.size() == old_state_set[i].size())
-                    {//equal的判断集合相等的写法，但OJ编译不通过，只能用集合差  equal(tempset.begin(), tempset.end(), old_state_set[i].begin(), old_state_set[i].end())
-                        //如果有相等的集合，则不是新集合
-                        is_new_state = 0;
-                        break;
-                    }
-                }
-                //是新集合且不为空集合，new_state_set队列中
-                if (is_new_state == 1 && !tempset.empty())
+                if (I[i][t.second / 64] >> (t.second % 64) & 1)
                 {
-                    new_state_set.push(tempset);
+                    DFAM.accept.insert(i);
+                    DFAM.tag[i] = t.first;
+                    break;
                 }
-
             }
-
-        }//while
-
-        //重命名表生成
-        rename_table = rename(I);
-
-        //转化为DFA，一边查表一边转化为DFA
-        DFAM.word = NFAM.word;//复制字母表
-        DFAM.word.erase('~');//去掉空字符
-        for (unsigned int i = 0; i < I.size(); i++)
-        {
-            //遍历vector I，I和map是每行对应的
-            //DFAM插入状态
-
-            DFAM.state.insert(rename_table[I[i]]);
-
-            //DFAM每个状态对应的转换关系进行添加 遍历word相当于在横向遍历map
-            for (std::set<char>::iterator it = DFAM.word.begin(); it != DFAM.word.end(); it++)
+            for (std::size_t k = 0; k < dense.word.size(); k++)
+                DFAM.table[i * DFAM.classes + merged[k + 1]] = table[i][k];
+            for (char w : DFAM.word)
             {
-                struct trans DFAMtemptrans;
                 //是空集合则跳过转换关系添加
-                if (word_move_map[*it][i].empty())
-                {
+                int k = dense.byteClass[(unsigned char) w] - 1;
+                if (table[i][k] < 0)
                     continue;
-                }
-                DFAMtemptrans.start = rename_table[I[i]];
-                DFAMtemptrans.receive = *it;;
-                DFAMtemptrans.end = rename_table[word_move_map[*it][i]];
+                struct trans DFAMtemptrans;
+                DFAMtemptrans.start = i;
+                DFAMtemptrans.receive = w;
+                DFAMtemptrans.end = table[i][k];
                 DFAM.transfunc.push_back(DFAMtemptrans);
             }
         }
 
-        //对DFA的transfunc进行重新排序，达到用例格式 X,Y,0,1,2.....
-        resort_trans(DFAM);
-
         return DFAM;
 
     }
 
 
-    void DFAoutput(struct DFA DFAM)
+    void DFAoutput(const struct DFA &DFAM)
     {
-        unsigned int j = 0;
-        int countline = 0;//2020.12.29
-        char nowstate;
-        for (unsigned int i = 0; i < DFAM.transfunc.size(); i++)
-        {
-            if (j == 0)
-            {
-                nowstate = DFAM.transfunc[i].start;
-
-                if (nowstate != 'Y' && countline == 1)
-                {//2020.12.29
-                    printf("Y \n");       //2020.12.29
-                }//2020.12.29
-
-                printf("%c ", DFAM.transfunc[i].start);
-                j++;
-            }
-            if (j != 0)
-            {
-                if ((i + 1) < DFAM.transfunc.size())
-                {
-                    if (DFAM.transfunc[i + 1].start == nowstate)
-                    {
-                        printf("%c-%c->%c ", DFAM.transfunc[i].start, DFAM.transfunc[i].receive, DFAM.transfunc[i].end);
-                    } else
-                    {
-                        printf("%c-%c->%c\n", DFAM.transfunc[i].start, DFAM.transfunc[i].receive,
-                               DFAM.transfunc[i].end);
-                        j = 0;
-                        countline++;//2020.12.29
-                    }
-                } else
-                {
-                    printf("%c-%c->%c", DFAM.transfunc[i].start, DFAM.transfunc[i].receive, DFAM.transfunc[i].end);
-                }
-            }
-
-        }
-
+        writeAutomaton(std::cout, DFAM.start, DFAM.accept, DFAM.state, DFAM.transfunc);
     }
 
-    void DFAoutput2File(struct DFA DFAM)
+    void DFAoutput2File(const struct DFA &DFAM)
     {
-        FILE *fout = fopen("tmp_nfa2dfa.txt", "w");
-        unsigned int j = 0, markA = 0;
-        char nowstate;
-        for (unsigned int i = 0; i < DFAM.transfunc.size(); i++)
-        {
-            if (j == 0)
-            {
-                nowstate = DFAM.transfunc[i].start;
-                fprintf(fout, "%c ", DFAM.transfunc[i].start);
-                j++;
-            }
-            if (j != 0)
-            {
-                if ((i + 1) < DFAM.transfunc.size())
-                {
-                    if (DFAM.transfunc[i + 1].start == nowstate)
-                    {
-                        fprintf(fout, "%c-%c->%c ", DFAM.transfunc[i].start, DFAM.transfunc[i].receive,
-                                DFAM.transfunc[i].end);
-                    } else
-                    {
-                        fprintf(fout, "%c-%c->%c\n", DFAM.transfunc[i].start, DFAM.transfunc[i].receive,
-                                DFAM.transfunc[i].end);
-                        j = 0;
-                        if (markA == 0)
-                        {
-                            fprintf(fout, "Y \n");
-                            markA++;
-                        }
-                    }
-                } else
-                {
-                    fprintf(fout, "%c-%c->%c", DFAM.transfunc[i].start, DFAM.transfunc[i].receive,
-                            DFAM.transfunc[i].end);
-                }
-            }
-        }
-        fprintf(fout, "\n\n");
-        fclose(fout);
+        std::ofstream of("tmp_nfa2dfa.txt");
+        writeAutomaton(of, DFAM.start, DFAM.accept, DFAM.state, DFAM.transfunc);
+        of.close();
     }
 
     void nfa2dfa()
@@ -1151,15 +1466,9 @@ namespace nfa2dfa
 
 namespace dfaSimplify
 {
-    typedef struct PathList
-    { //存一条通路
-        char cDFA_State[20];
-        int underse_sum = 0;
-    } PathList;
-    PathList pList[10];
     typedef struct DFA_State
     { //存边
-        char Startname, Endname;
+        int Startname, Endname;
         char Condition;
         int yesEdge;
 
@@ -1174,428 +1483,382 @@ namespace dfaSimplify
     {
     public:
         std::vector<DFA_State> dfaStateList; //存边
-        std::vector<std::vector<char> > splitStates; //存分割子集
+        std::vector<std::vector<int> > splitStates; //存分割子集
+        int start = 0;                       //初态
+        std::set<int> accept;                //终态集合
+        std::map<int, int> tag;              //终态 -> 规则编号，多规则词法分析时使用
+        std::vector<unsigned char> byteClass; //nfa2dfa求出的字节等价类，从文件读入时为空
+        std::vector<char> character;         //merge()后的输入符
+        std::vector<DFA_State> resultList;   //merge()后的DFA边
         void input();
 
-        void elimDeadState();
+        void input(const nfa2dfa::DFA &DFAM);
 
-        int DFSTraverse(char S_tart, PathList pList[]); //开始坐标、通路数组
-        void DFS(char S_tart, bool bVisited[], int &nIndex, PathList pList[], int &sum);
+        void initSplit(const std::set<int> &states);
 
-        int find_Edge(char S_tart, char S_end);
+        void elimDeadState();
 
-        int find_Char(char State);
+        void BFS(std::vector<int> queue, const std::unordered_map<int, std::vector<int> > &edges,
+                 std::unordered_set<int> &visited);
 
         void simple();
 
-        int findset(char Endname);
-
-        void split(int i, std::map<int, std::vector<char> > &res);
-
-
-        bool is_element_in_vector(char Startname, std::vector<char> dfaState);
-
         void merge();
 
-        void output();
+        void output(std::ostream &os) const;
+
+        void outputToFile() const;
     };
 
     void dfaSimplify::DFA::input()
     {   //用于输入DFA信息
-        std::streambuf *cinBuf = std::cin.rdbuf();
         std::ifstream inf("tmp_nfa2dfa.txt");
-        std::streambuf *fileBuf = inf.rdbuf();
-        std::cin.rdbuf(fileBuf);
-
-        DFA_State dfaState[20];
-        for (int i = 0; i < 20; i++) dfaState[i].yesEdge = 1;
-        int j = 0;
-        std::string str;
-        std::vector<char> EndSt, noEndSt;
-        getline(std::cin, str, '\n');
-        while (str.length() != 0)
-        {
-            if (str.length() == 1)
-            {
-                if (str[0] == 'Y') EndSt.push_back(str[0]);
-                else noEndSt.push_back(str[0]);
-                getline(std::cin, str, '\n'); //输入string串
-            } else
-            {
-                dfaState[j].Startname = str[0];//边起始
-                for (int i = 1; str[i] != '\0'; i++)
-                {
-                    if (str[i - 1] == '-' && str[i + 1] == '-') dfaState[j].Condition = str[i];//条件
-                    else if (str[i] == '>')
-                    {
-                        dfaState[j].Endname = str[++i]; //边终点
-                        //测试代码
-                        //cout<<dfaState[j].Startname<<' '<<dfaState[j].Condition<<' '<<dfaState[j].Endname<<endl;
-                        dfaStateList.push_back(dfaState[j++]);
-                        dfaState[j].Startname = str[0];
-                    }
-                }
-                if (str[0] == 'Y') EndSt.push_back(str[0]);
-                else noEndSt.push_back(str[0]);
-                getline(std::cin, str, '\n'); //输入string串
-            }
+        std::set<int> state;
+        std::vector<nfa2dfa::trans> transfunc;
+        nfa2dfa::readAutomaton(inf, start, accept, state, transfunc);
+
+        DFA_State dfaState;
+        dfaState.yesEdge = 1;
+        for (const nfa2dfa::trans &t : transfunc)
+        {
+            dfaState.Startname = t.start;
+            dfaState.Condition = t.receive;
+            dfaState.Endname = t.end;
+            dfaStateList.push_back(dfaState);
         }
-        splitStates.push_back(noEndSt), splitStates.push_back(EndSt);
-        // for(int i=0;i<dfaStateList.size();i++)
-        //{
-        // cout<<dfaStateList[i].Startname<<' '<<dfaStateList[i].Condition
-        //<<' '<<dfaStateList[i].Endname;
-        // cout<<endl;
-        // }
+        initSplit(state);
 
         inf.close();
-        std::cin.rdbuf(cinBuf);
     }
 
-    int dfaSimplify::DFA::findset(char Endname)
-    { //还未划分时 非终结符、终结符各一行。用于获得某状态属于哪个集合
-        for (std::size_t i = 0; i < splitStates.size(); i++)
-            for (std::size_t j = 0; j < splitStates.size(); j++)
-                if (Endname == splitStates[i][j])
-                    return i;
-    }
-
-    int dfaSimplify::DFA::find_Edge(char S_tart, char S_end) //用于找出以S_tart为起始,以S_end为终态的边
-    {
-        for (std::size_t i = 0; i < dfaStateList.size(); i++)
-            if (dfaStateList[i].Startname == S_tart && dfaStateList[i].Endname == S_end)
-                return i;
-        return -1;
+    void dfaSimplify::DFA::input(const nfa2dfa::DFA &DFAM)
+    {   //直接使用nfa2dfa的结果
+        DFA_State dfaState;
+        dfaState.yesEdge = 1;
+        for (const nfa2dfa::trans &t : DFAM.transfunc)
+        {
+            dfaState.Startname = t.start;
+            dfaState.Condition = t.receive;
+            dfaState.Endname = t.end;
+            dfaStateList.push_back(dfaState);
+        }
+        start = DFAM.start;
+        accept = DFAM.accept;
+        tag = DFAM.tag;
+        byteClass = DFAM.byteClass;
+        initSplit(DFAM.state);
     }
 
-    int DFA::find_Char(char State) //用于找出某状态是否存在于状态集合中
+    //初始划分：非终态一组，终态按所属规则各成一组(没有规则标记时终态都在一组)
+    void DFA::initSplit(const std::set<int> &states)
     {
-        for (std::size_t i = 0; i < splitStates.size(); i++)
-            for (std::size_t j = 0; j < splitStates[i].size(); j++)
-                if (State == splitStates[i][j]) return i;
-        return -1;
+        std::map<int, std::vector<int> > groups;
+        for (int state : states)
+        {
+            int key = -1;
+            if (accept.count(state))
+                key = tag.count(state) ? tag[state] : 0;
+            groups[key].push_back(state);
+        }
+        splitStates.clear();
+        for (std::pair<const int, std::vector<int> > &group : groups)
+            splitStates.push_back(group.second);
     }
 
-    //DFS遍历得到从起始点到终态的所有通路
-    void DFA::DFS(char S_tart, bool bVisited[], int &nIndex, PathList pList[], int &sum)
+    //从queue中的状态出发沿edges做BFS，到达的状态放进visited
+    void DFA::BFS(std::vector<int> queue, const std::unordered_map<int, std::vector<int> > &edges,
+                  std::unordered_set<int> &visited)
     {
-        bVisited[int(S_tart)] = true; //改为已访问
-        pList[sum].cDFA_State[nIndex++] = S_tart;//访问S_tart状态
-
-        int num = 0;
-        for (std::size_t i = 0; i < splitStates.size(); i++)
-            for (std::size_t j = 0; j < splitStates[i].size(); j++)
+        visited.insert(queue.begin(), queue.end());
+        for (std::size_t i = 0; i < queue.size(); i++)
+        {
+            std::unordered_map<int, std::vector<int> >::const_iterator it = edges.find(queue[i]);
+            if (it == edges.end())
+                continue;
+            for (int next : it->second)
             {
-                if (bVisited[int(splitStates[i][j])])
-                    num++; //边上总共有几个点
+                if (visited.insert(next).second)
+                    queue.push_back(next);
             }
-
-        if (pList[sum].cDFA_State[nIndex - 1] == 'Y') //找到一条通路
-        {
-            if (sum != 0) pList[sum].cDFA_State[0] = 'X'; //只有第一条通路的第一个点被赋值为了初态.所以这里有个判断
-            pList[sum].underse_sum = num;
-            sum++;
-            //保存一条路径
-        } else
-        {
-            for (std::size_t i = 0; i < splitStates.size(); i++)
-                for (std::size_t j = 0; j < splitStates[i].size(); j++)
-                {
-                    int number = find_Edge(S_tart, splitStates[i][j]);
-                    if (number >= 0 && !bVisited[int(splitStates[i][j])]) //有边并且这个点没访问过(防止形成环)
-                    {
-                        DFS(splitStates[i][j], bVisited, nIndex, pList, sum);
-                        bVisited[int(splitStates[i][j])] = false;
-                        nIndex--;
-                    }
-                }
         }
     }
 
-    //用于调用DFS得到所有通路,返回通路数
-    int DFA::DFSTraverse(char S_tart, PathList pList[])
-    {
-        bool bVisted[100] = {false};
-        int nIndex = 0, sum = 0;
-        DFS(S_tart, bVisted, nIndex, pList, sum);
-        return sum;
-        //从S_tart开始状态,bVisited记录是否访问过,nIndex记录状态数,pList为通路链表,sum为总通路数
-    }
-
-    //思路：找从起点开始找到终结点的通路。
-    //       遍历各个通路,如果某点不存在任何一个通路上,则证明该点为死状态点
+    //思路：从初态沿边正向BFS得到可达状态，从各终态沿反向边BFS得到能到终态的状态，
+    //       两者都不满足其一的就是死状态，整个过程和边数成线性
     //用于消除死状态、死状态对应的边
     void DFA::elimDeadState()
     {
-        //从开始顶点X找到各个通路
-        char S_tart = 'X';
-        int s_Pathway = DFSTraverse(S_tart, pList);
-
-        //遍历各个通路,遍历过程中更新状态集合以及边集合
-        //更新状态
-        std::vector<char> noEndSt, EndSt;
-        EndSt.push_back('Y');
-        for (int i = 0; i < s_Pathway; i++)
-            for (int under = 0; under < pList[i].underse_sum; under++)
-            {
-                char Ele_st = pList[i].cDFA_State[under];
-                if (find(noEndSt.begin(), noEndSt.end(), Ele_st) == noEndSt.end() && Ele_st != 'Y')
-                    noEndSt.push_back(Ele_st);
-            }
-        splitStates.clear();
-        splitStates.push_back(noEndSt);
-        splitStates.push_back(EndSt);
-        /*for(int i=0;i<splitStates.size();i++)
+        std::unordered_map<int, std::vector<int> > forward, backward;
+        for (const DFA_State &edge : dfaStateList)
         {
-
-            for(int j=0;j<splitStates[i].size();j++)
-                cout<<splitStates[i][j];
-            cout<<endl;
-        }*/
-
+            forward[edge.Startname].push_back(edge.Endname);
+            backward[edge.Endname].push_back(edge.Startname);
+        }
+        std::unordered_set<int> reach, coreach;
+        BFS(std::vector<int>(1, start), forward, reach);
+        BFS(std::vector<int>(accept.begin(), accept.end()), backward, coreach);
+
+        //更新状态，初态即使到不了终态也要保留
+        std::set<int> live;
+        live.insert(start);
+        for (int state : reach)
+        {
+            if (coreach.count(state))
+                live.insert(state);
+        }
+        initSplit(live);
 
         //更新边集合
         std::vector<DFA_State> dfaStateList2;
         for (std::size_t i = 0; i < dfaStateList.size(); i++)
         {
-            char S_tart = dfaStateList[i].Startname;
-            char S_end = dfaStateList[i].Endname;
-            if (find_Char(S_tart) >= 0 && find_Char(S_end) >= 0)
+            if (live.count(dfaStateList[i].Startname) && live.count(dfaStateList[i].Endname))
                 dfaStateList2.push_back(dfaStateList[i]);
         }
-        dfaStateList.clear();
-        for (std::size_t i = 0; i < dfaStateList2.size(); i++)
-        {
-            dfaStateList.push_back(dfaStateList2[i]);
-        }
-
-        /*for(int i=0;i<dfaStateList.size();i++)
-        {
-            cout<<dfaStateList[i].Startname<<' '<<dfaStateList[i].Condition<<' '<<dfaStateList[i].Endname;
-            cout<<endl;
-        }*/
-
-
-
-        /*for(int i=0;i<s_Pathway;i++) //输出各通路信息,用于测试
-        {
-            for(int under=0;under<pList[i].underse_sum;under++)
-              cout<<pList[i].cDFA_State[under];
-            cout<<endl;
-        }*/
-    }
-
-    //用于对splitStates[i]集合,以res分割集合进行分割
-    void DFA::split(int i, std::map<int, std::vector<char> > &res)
-    {
-        std::map<int, std::vector<char> >::iterator iter;
-        iter = res.begin();
-
-        splitStates[i].clear();
-        splitStates[i].assign((iter->second).begin(), (iter->second).end());
-        iter++;
-
-        while (iter != res.end())
-        {
-            splitStates.push_back(iter->second);
-            iter++;
-        }
-
-        /*for(int i=0;i<splitStates.size();i++)
-           {
-               for(int j=0;j<splitStates[i].size();j++)
-                 cout<<splitStates[i][j]<<" ";
-               cout<<endl;
-           }
-        cout<<endl;*/ //测试代码
+        dfaStateList.swap(dfaStateList2);
     }
 
-    //使用分割法进行状态化简
+    //使用Hopcroft划分细化进行状态化简，O(m n log n)，m为字母表大小
+    //在稠密的转换表上做，字母表取dfaStateList里实际出现的输入符；
+    //转换表中缺的边都指向一个额外的死状态，化简后再把它去掉
     void DFA::simple()
     {
-        char End[] = {'a', 'b', 'c','d','e','f','g','A','B','C','D','E','F', '~', '0', '1', '\0'};
-        std::map<int, std::vector<char> > res;
-        bool flag = false;
-        std::size_t i = 0;
-        for (i = 0; i < splitStates.size(); i++)
-        { //对各状态子集进行不断分割
-            if (splitStates[i].size() > 1)
-            {
-                flag = false;
-                for (int endChar = 0; endChar < sizeof(End)/sizeof(char); endChar++)
-                { //对于每个输入
-                    for (std::size_t j = 0; j < splitStates[i].size(); j++)
-                    { //每个子集有splitStates[i].size()个元素
-                        bool haveEdge = false;
-                        for (std::size_t k = 0; k < dfaStateList.size(); k++)
-                        {
-                            char Edge_Start = dfaStateList[k].Startname;
-                            if (Edge_Start == splitStates[i][j] && dfaStateList[k].Condition == End[endChar])
-                            {
-                                int number = findset(dfaStateList[k].Endname); //找到该弧转换到的状态所属的划分集合号
-                                if (res.count(number) == 0)
-                                    res.insert(
-                                            std::pair<int, std::vector<char> >(number,
-                                                                               std::vector<char>(1, Edge_Start)));
-                                else res[number].push_back(Edge_Start);
-                                haveEdge = true;
-                                break;
-                            }
-                        }
-                        if (!haveEdge)
-                        {
-                            if (res.count(-1) == 0)
-                                res.insert(std::pair<int, std::vector<char> >(noEdge,
-                                                                              std::vector<char>(1, splitStates[i][j])));
-                            else
-                                res[-1].push_back(splitStates[i][j]);
-                        }
-
-                    }
-                    if (res.size() > 1)
-                    {
-                        split(i, res); //第i个集合,通过res字典划分
-                        flag = true;
-                        res.clear();
-                        break;
-                    }
-                    res.clear();
-                }
-                if (flag) i = -1;//说明发生了集合分割,需要从头开始遍历。
+        std::vector<int> name;          //编号 -> 状态名
+        std::map<int, int> id;          //状态名 -> 编号
+        std::map<char, int> wordIndex;  //输入符 -> 编号
+        for (std::size_t i = 0; i < splitStates.size(); i++)
+            for (int state : splitStates[i])
+            {
+                id[state] = name.size();
+                name.push_back(state);
+            }
+        for (const DFA_State &edge : dfaStateList)
+        {
+            if (!wordIndex.count(edge.Condition))
+            {
+                int k = wordIndex.size();
+                wordIndex[edge.Condition] = k;
             }
         }
-    }
+        int n = name.size() + 1, m = wordIndex.size(), sink = n - 1;
+        if (m == 0)
+            return;
 
-    //判断某name在vector中是否存在
-    bool DFA::is_element_in_vector(char Startname, std::vector<char> dfaState)
-    {
-        for (std::size_t i = 0; i < dfaState.size(); i++)
-            if (Startname == dfaState[i]) return true;
-        return false;
-    }
-
-    //用于状态合并
-    void DFA::merge()
-    {
-        std::map<std::vector<char>, char> Old_result;
-        std::vector<char> sameState;
-        for (std::size_t i = 0; i < splitStates.size(); i++)
+        //转换表delta[p*m+k]，以及反向表inv[k*n+t]: 经第k个输入符到达t的所有状态
+        std::vector<int> delta(n * m, sink);
+        for (const DFA_State &edge : dfaStateList)
         {
-            sameState.clear();
-            for (std::size_t j = 0; j < splitStates[i].size(); j++) sameState.push_back(splitStates[i][j]);
-            Old_result.insert(std::pair<std::vector<char>, char>(sameState, splitStates[i][0]));
-        } //map容器复制 各子集为key,标志状态为value
-
-        for (std::size_t k = 0; k < dfaStateList.size(); k++)  //对于每条边
+            if (id.count(edge.Startname) && id.count(edge.Endname))
+                delta[id[edge.Startname] * m + wordIndex[edge.Condition]] = id[edge.Endname];
+        }
+        std::vector<std::vector<int> > inv(m * n);
+        for (int p = 0; p < n; p++)
+            for (int k = 0; k < m; k++)
+                inv[k * n + delta[p * m + k]].push_back(p);
+
+        //可细化划分：每个块在elems中占一段[first, last)，块内前marked个元素是本轮被标记的
+        std::vector<int> elems, loc(n), blk(n), first, last, marked;
+        int sinkBlock = -1;
+        for (std::size_t i = 0; i < splitStates.size(); i++)
         {
-            char Start = dfaStateList[k].Startname;
-            char End = dfaStateList[k].Endname; //得到起点和终点
-            for (std::size_t i = 0; i < splitStates.size(); i++)
+            if (splitStates[i].empty())
+                continue;
+            int b = first.size();
+            first.push_back(elems.size());
+            for (int state : splitStates[i])
             {
-                if (is_element_in_vector(Start, splitStates[i]) && is_element_in_vector(End, splitStates[i]) &&
-                    Start != End)
-                {
-                    dfaStateList[k].yesEdge = -1; //该边删 置标志位为-1.
-                    break;
-                }
+                blk[id[state]] = b;
+                loc[id[state]] = elems.size();
+                elems.push_back(id[state]);
             }
-            for (std::size_t i = 0; i < splitStates.size(); i++)
+            if (sinkBlock < 0 && !accept.count(splitStates[i][0]))
             {
-                //修改边的始末点为map中的value
-                if (is_element_in_vector(Start, splitStates[i])) dfaStateList[k].Startname = Old_result[splitStates[i]];
-                if (is_element_in_vector(End, splitStates[i])) dfaStateList[k].Endname = Old_result[splitStates[i]];
+                //死状态不是终态，和非终态放在同一个初始块
+                sinkBlock = b;
+                blk[sink] = b;
+                loc[sink] = elems.size();
+                elems.push_back(sink);
             }
+            last.push_back(elems.size());
+            marked.push_back(0);
+        }
+        if (sinkBlock < 0)
+        {
+            blk[sink] = first.size();
+            loc[sink] = elems.size();
+            first.push_back(elems.size());
+            elems.push_back(sink);
+            last.push_back(elems.size());
+            marked.push_back(0);
         }
 
-        //去重
-        std::vector<DFA_State> dfaStatesNew;
-        for (std::size_t i = 0; i < dfaStateList.size(); i++)
+        //待处理的(块, 输入符)，初始时放入除最大块以外的所有块
+        std::vector<std::pair<int, int> > work;
+        std::vector<char> inWork(first.size() * m, 0);
+        int largest = 0;
+        for (std::size_t b = 1; b < first.size(); b++)
+            if (last[b] - first[b] > last[largest] - first[largest])
+                largest = b;
+        for (std::size_t b = 0; b < first.size(); b++)
         {
-            if (find(dfaStatesNew.begin(), dfaStatesNew.end(), dfaStateList[i]) == dfaStatesNew.end())
+            if ((int) b == largest)
+                continue;
+            for (int k = 0; k < m; k++)
             {
-                dfaStatesNew.push_back(dfaStateList[i]);
+                work.push_back(std::make_pair(b, k));
+                inWork[b * m + k] = 1;
             }
         }
-        //输出 先输出ab# XY02#
-        std::vector<char> character;
-        for (std::size_t k = 0; k < dfaStatesNew.size(); k++)
-        {
-            //将输入符push到vector中
-            if (std::find(character.begin(), character.end(), dfaStatesNew[k].Condition) == character.end())
-                character.push_back(dfaStatesNew[k].Condition);
-        }
-        //输出a b#
-        for (std::size_t k = 0; k < character.size() - 1; k++)
-            std::cout << character[k] << ' ';
-        std::cout << character[character.size() - 1] << '#' << std::endl;
 
-        //输出X Y 0 2#
-        for (std::size_t i = 0; i < splitStates.size() - 1; i++)
-            std::cout << splitStates[i][0] << ' ';
-        std::cout << splitStates[splitStates.size() - 1][0] << '#' << std::endl;
-
-        //输出DFA
-        for (std::size_t i = 0; i < splitStates.size(); i++) //对于每个splitStates[i][0]
+        std::vector<int> splitter, touched;
+        while (!work.empty())
         {
-            if(splitStates[i][0]=='X'||splitStates[i][0]=='Y'||splitStates[i][0]<='9'&&splitStates[i][0]>='0'){
+            int B = work.back().first, k = work.back().second;
+            work.pop_back();
+            inWork[B * m + k] = 0;
 
-            }else{
-                continue;
+            //标记所有经k进入B的状态
+            splitter.assign(elems.begin() + first[B], elems.begin() + last[B]);
+            for (int t : splitter)
+            {
+                for (int p : inv[k * n + t])
+                {
+                    int C = blk[p], pos = first[C] + marked[C];
+                    if (loc[p] < pos)
+                        continue;
+                    if (marked[C] == 0)
+                        touched.push_back(C);
+                    int q = elems[pos];
+                    elems[loc[p]] = q;
+                    loc[q] = loc[p];
+                    elems[pos] = p;
+                    loc[p] = pos;
+                    marked[C]++;
+                }
             }
-            std::cout << splitStates[i][0] << ' ';
-            for (std::size_t k = 0; k < dfaStatesNew.size(); k++)
+
+            //被部分标记的块一分为二，较小的一半成为新块
+            for (int C : touched)
             {
-                //如果不为-1并且起始点为splitStates[i][0]
-                if (dfaStatesNew[k].yesEdge != -1 && dfaStatesNew[k].Startname == splitStates[i][0])
+                int mid = first[C] + marked[C];
+                marked[C] = 0;
+                if (mid == last[C])
+                    continue;
+                int D = first.size();
+                if (mid - first[C] <= last[C] - mid)
+                {
+                    first.push_back(first[C]);
+                    last.push_back(mid);
+                    first[C] = mid;
+                } else
+                {
+                    first.push_back(mid);
+                    last.push_back(last[C]);
+                    last[C] = mid;
+                }
+                marked.push_back(0);
+                for (int i = first[D]; i < last[D]; i++)
+                    blk[elems[i]] = D;
+
+                inWork.resize(first.size() * m, 0);
+                for (int a = 0; a < m; a++)
                 {
-                    std::cout << dfaStatesNew[k].Startname << '-' << dfaStatesNew[k].Condition << '-' << '>'
-                              << dfaStatesNew[k].Endname;
-                    std::cout << ' ';
+                    int add = D;
+                    if (!inWork[C * m + a] && last[C] - first[C] < last[D] - first[D])
+                        add = C;
+                    if (!inWork[add * m + a])
+                    {
+                        work.push_back(std::make_pair(add, a));
+                        inWork[add * m + a] = 1;
+                    }
                 }
             }
-            std::cout << std::endl;
+            touched.clear();
         }
 
-        //输出到文件
-        std::streambuf *coutBuf = std::cout.rdbuf();
-        std::ofstream of("tmp_dfa_simpilify.txt");
-        std::streambuf *fileBuf = of.rdbuf();
-        std::cout.rdbuf(fileBuf);
-
-        //输出a b#
-        for (std::size_t k = 0; k < character.size() - 1; k++)
-            std::cout << character[k] << ' ';
-        std::cout << character[character.size() - 1] << '#' << std::endl;
+        //按块重建splitStates，去掉死状态
+        splitStates.clear();
+        for (std::size_t b = 0; b < first.size(); b++)
+        {
+            std::vector<int> group;
+            for (int i = first[b]; i < last[b]; i++)
+                if (elems[i] != sink)
+                    group.push_back(name[elems[i]]);
+            if (!group.empty())
+                splitStates.push_back(group);
+        }
+    }
 
-        //输出X Y 0 2#
-        for (std::size_t i = 0; i < splitStates.size() - 1; i++)
-            std::cout << splitStates[i][0] << ' ';
-        std::cout << splitStates[splitStates.size() - 1][0] << '#' << std::endl;
+    //用于状态合并：每个子集取一个标志状态，边的始末点都换成标志状态后去重
+    void DFA::merge()
+    {
+        //含初态的子集以初态为标志状态
+        std::map<int, int> Old_result;
+        for (std::size_t i = 0; i < splitStates.size(); i++)
+        {
+            std::vector<int>::iterator it = std::find(splitStates[i].begin(), splitStates[i].end(), start);
+            if (it != splitStates[i].end())
+                std::iter_swap(splitStates[i].begin(), it);
+            for (int state : splitStates[i])
+                Old_result[state] = splitStates[i][0];
+        } //各状态为key,所在子集的标志状态为value
+
+        std::set<std::pair<std::pair<int, char>, int> > seen;
+        character.clear();
+        resultList.clear();
+        for (std::size_t k = 0; k < dfaStateList.size(); k++)  //对于每条边
+        {
+            if (!Old_result.count(dfaStateList[k].Startname) || !Old_result.count(dfaStateList[k].Endname))
+                continue;
+            DFA_State edge = dfaStateList[k];
+            edge.Startname = Old_result[edge.Startname];
+            edge.Endname = Old_result[edge.Endname];
+            //去重
+            if (!seen.insert(std::make_pair(std::make_pair(edge.Startname, edge.Condition), edge.Endname)).second)
+                continue;
+            resultList.push_back(edge);
+            //输入符
+            if (std::find(character.begin(), character.end(), edge.Condition) == character.end())
+                character.push_back(edge.Condition);
+        }
 
-        //输出DFA
-        for (std::size_t i = 0; i < splitStates.size(); i++) //对于每个splitStates[i][0]
+        //终态和规则标记也换成标志状态
+        std::set<int> mergedAccept;
+        std::map<int, int> mergedTag;
+        for (std::size_t i = 0; i < splitStates.size(); i++)
         {
-            if(splitStates[i][0]=='X'||splitStates[i][0]=='Y'||splitStates[i][0]<='9'&&splitStates[i][0]>='0'){
+            if (accept.count(splitStates[i][0]))
+                mergedAccept.insert(splitStates[i][0]);
+            if (tag.count(splitStates[i][0]))
+                mergedTag[splitStates[i][0]] = tag[splitStates[i][0]];
+        }
+        accept = mergedAccept;
+        tag = mergedTag;
+    }
 
-            }else{
-                continue;
-            }
-            std::cout << splitStates[i][0] << ' ';
-            for (std::size_t k = 0; k < dfaStatesNew.size(); k++)
-            {
-                //如果不为-1并且起始点为splitStates[i][0]
-                if (dfaStatesNew[k].yesEdge != -1 && dfaStatesNew[k].Startname == splitStates[i][0])
-                {
-                    std::cout << dfaStatesNew[k].Startname << '-' << dfaStatesNew[k].Condition << '-' << '>'
-                              << dfaStatesNew[k].Endname;
-                    std::cout << ' ';
-                }
-            }
-            std::cout << std::endl;
+    //输出化简结果，格式同nfa2dfa::writeAutomaton
+    void DFA::output(std::ostream &os) const
+    {
+        std::set<int> state;
+        std::vector<nfa2dfa::trans> transfunc;
+        for (std::size_t i = 0; i < splitStates.size(); i++)
+            state.insert(splitStates[i][0]);
+        for (const DFA_State &edge : resultList)
+        {
+            nfa2dfa::trans t;
+            t.start = edge.Startname;
+            t.receive = edge.Condition;
+            t.end = edge.Endname;
+            transfunc.push_back(t);
         }
-        of.flush();
+        nfa2dfa::writeAutomaton(os, start, accept, state, transfunc);
+    }
+
+    void DFA::outputToFile() const
+    {
+        std::ofstream of("tmp_dfa_simpilify.txt");
+        output(of);
         of.close();
-        std::cout.rdbuf(coutBuf);
     }
 
     void dfaSimplify()
@@ -1606,6 +1869,8 @@ namespace dfaSimplify
         dfa.simple();
 
         dfa.merge();
+        dfa.output(std::cout);
+        dfa.outputToFile();
     }
 }
 
@@ -1616,129 +1881,575 @@ namespace dfaIdentity
     {
     public:
         std::set<char> word;   //单词集合
-        std::set<char> status; //状态集合
-        std::map<std::string, std::string> dfa;   //DFA关系集合
+        std::set<int> status;  //状态集合
+        std::vector<unsigned char> byteClass;  //256项，字节 -> 等价类
+        uint32_t classes = 1;                  //等价类个数，即转换表每行的长度
+        std::vector<uint32_t> table;           //转换表，table[state+等价类]，状态都存成行首下标(编号*classes)，0为死状态
+        std::vector<unsigned char> accepting;  //accepting[state/classes]为1表示终态
+        std::vector<int> rule;                 //rule[state/classes]为终态对应的规则编号，否则为-1
+        uint32_t start = 0;                    //初态的行首下标
+        std::vector<uint32_t> search;          //查找用的转换表，格式同table，见creat_search()
+        std::vector<unsigned char> searchAccept; //searchAccept[行首下标]为1表示有匹配在这里结束
+        std::string prefix;                    //每个匹配都以它开头，见regex2nfa::Regex2Nfa::literalPrefix()
         std::string Str = "";
 
+        // 把DFA编成[状态][等价类]的转换表：状态按出现顺序编号为1..n，缺的边都指向0号死状态；
+        // 表里直接存下一状态的行首下标。classOf为空时按transfunc重新求等价类
+        void creat_table(int startName, const std::set<int> &accept, const std::vector<nfa2dfa::trans> &transfunc,
+                         const std::vector<unsigned char> &classOf, const std::map<int, int> &tag)
+        {
+            if (classOf.empty())
+                classes = nfa2dfa::byteClasses(transfunc, byteClass);
+            else
+            {
+                byteClass = classOf;
+                classes = *std::max_element(byteClass.begin(), byteClass.end()) + 1;
+            }
+
+            std::map<int, uint32_t> index;
+            uint32_t stride = classes;
+            auto number = [&index, stride](int state) -> uint32_t
+            {
+                std::map<int, uint32_t>::iterator it = index.find(state);
+                if (it != index.end())
+                    return it->second;
+                uint32_t id = (index.size() + 1) * stride;
+                index[state] = id;
+                return id;
+            };
+            start = number(startName);
+            for (const nfa2dfa::trans &t : transfunc)
+            {
+                number(t.start);
+                number(t.end);
+            }
+
+            table.assign((index.size() + 1) * classes, 0);
+            accepting.assign(index.size() + 1, 0);
+            rule.assign(index.size() + 1, -1);
+            for (const nfa2dfa::trans &t : transfunc)
+            {
+                word.insert(t.receive);
+                status.insert(t.start);
+                table[index[t.start] + byteClass[(unsigned char) t.receive]] = index[t.end];
+            }
+            for (int state : accept)
+            {
+                if (index.count(state))
+                    accepting[index[state] / classes] = 1;
+            }
+            for (const std::pair<const int, int> &t : tag)
+            {
+                if (index.count(t.first))
+                    rule[index[t.first] / classes] = t.second;
+            }
+        }
+
         // 利用文件生成dfa关系
         void creat_dfa_txt()
         {
             std::ifstream infile;
             infile.open("tmp_dfa_simpilify.txt");
-            std::string Str;
-            int z = 0;
-            while (getline(infile, Str))
+            int s = 0;
+            std::set<int> acceptStates;
+            std::vector<nfa2dfa::trans> transfunc;
+            nfa2dfa::readAutomaton(infile, s, acceptStates, status, transfunc);
+            creat_table(s, acceptStates, transfunc, std::vector<unsigned char>(), std::map<int, int>());
+        }
+
+        // 直接利用dfaSimplify的化简结果生成dfa关系
+        void creat_dfa(const dfaSimplify::DFA &simplified)
+        {
+            std::vector<nfa2dfa::trans> transfunc;
+            for (const dfaSimplify::DFA_State &edge : simplified.resultList)
+            {
+                nfa2dfa::trans t;
+                t.start = edge.Startname;
+                t.receive = edge.Condition;
+                t.end = edge.Endname;
+                transfunc.push_back(t);
+            }
+            creat_table(simplified.start, simplified.accept, transfunc, simplified.byteClass, simplified.tag);
+        }
+
+        // 整段输入是否被DFA接受，每个字节查一次等价类、一次转换表；进入死状态后提前结束
+        bool match(const char *s, std::size_t n) const
+        {
+            const uint32_t *t = table.data();
+            const unsigned char *cls = byteClass.data();
+            uint32_t state = start;
+            std::size_t i = 0;
+            for (; i + 4 <= n && state != 0; i += 4)
+            {
+                state = t[state + cls[(unsigned char) s[i]]];
+                state = t[state + cls[(unsigned char) s[i + 1]]];
+                state = t[state + cls[(unsigned char) s[i + 2]]];
+                state = t[state + cls[(unsigned char) s[i + 3]]];
+            }
+            for (; i < n && state != 0; i++)
+                state = t[state + cls[(unsigned char) s[i]]];
+            return accepting[state / classes];
+        }
+
+        // 批量匹配：第k个字符串为data[offsets[k]..offsets[k+1])，offsets共count+1项；
+        // 结果放进位图，bitmap[k/64]的第k%64位为1表示接受。同时走LANES个字符串，
+        // 各条路径的查表互不依赖，访存延迟可以重叠：每轮取各路剩余长度的最小值，
+        // 在这段里所有路径不带分支地同步前进，之后把走完的字符串换成下一个。
+        // 字符串平均不到32字节时每轮太短，逐个match()反而更快：循环次数不依赖查表结果，
+        // CPU的乱序执行已经能让相邻字符串的查表重叠
+        void matchBatch(const char *data, const std::size_t *offsets, std::size_t count,
+                        std::vector<uint64_t> &bitmap) const
+        {
+            const int LANES = 8;
+            const uint32_t *t = table.data();
+            const unsigned char *cls = byteClass.data();
+            const unsigned char *pos[LANES];
+            std::size_t left[LANES], id[LANES];
+            uint32_t state[LANES];
+            std::size_t next = 0;
+            int active = 0;     //正在走的路径是0..active-1
+            bitmap.assign((count + 63) / 64, 0);
+            if (count == 0 || offsets[count] - offsets[0] < count * 32)
+            {
+                //结果不做分支判断，否则下一个字符串要等这次查表结束才能开始
+                for (std::size_t k = 0; k < count; k++)
+                    bitmap[k / 64] |= (uint64_t) match(data + offsets[k], offsets[k + 1] - offsets[k]) << (k % 64);
+                return;
+            }
+            for (; active < LANES && next < count; active++, next++)
+            {
+                id[active] = next;
+                pos[active] = (const unsigned char *) data + offsets[next];
+                left[active] = offsets[next + 1] - offsets[next];
+                state[active] = start;
+            }
+            while (active > 0)
             {
-                if (z < 1)
+                std::size_t step = left[0];
+                for (int l = 1; l < active; l++)
+                    step = std::min(step, left[l]);
+                if (active == LANES)
                 {
-                    for (int i = 0; i < Str.size(); i++)
-                    {
-                        if (Str[i] != ' ' && Str[i] != '#')
-                        {
-                            word.insert(Str[i]);
-                        }
-                    }
+                    for (std::size_t i = 0; i < step; i++)
+                        for (int l = 0; l < LANES; l++)
+                            state[l] = t[state[l] + cls[pos[l][i]]];
                 } else
                 {
-                    std::string out = "";
-                    std::istringstream str(Str);
-                    str >> out;
-                    std::string pro = out;
-                    while (str >> out)
+                    for (std::size_t i = 0; i < step; i++)
+                        for (int l = 0; l < active; l++)
+                            state[l] = t[state[l] + cls[pos[l][i]]];
+                }
+                for (int l = 0; l < active; l++)
+                {
+                    pos[l] += step;
+                    left[l] -= step;
+                    if (left[l] > 0)
+                        continue;
+                    if (accepting[state[l] / classes])
+                        bitmap[id[l] / 64] |= 1ULL << (id[l] % 64);
+                    if (next < count)
                     {
-                        if (out.length() == 1)
-                            break;
-                        else
-                        {
-                            std::string f_c = "";
-                            f_c = f_c + pro;
-                            int i = 1 + out.find('-');
-                            // 生成关系字符串
-                            while (out[i] != '-')
-                            {
-                                f_c = f_c + out[i];
-                                i++;
-                            }
-                            // 关系变成字典
-                            dfa[f_c] = out.substr(i + 2, out.size() - i - 2);
-                        }
+                        id[l] = next;
+                        pos[l] = (const unsigned char *) data + offsets[next];
+                        left[l] = offsets[next + 1] - offsets[next];
+                        state[l] = start;
+                        next++;
+                    } else
+                    {
+                        //用最后一路补上这个空位
+                        active--;
+                        id[l] = id[active];
+                        pos[l] = pos[active];
+                        left[l] = left[active];
+                        state[l] = state[active];
+                        l--;
                     }
                 }
-                z++;
             }
         }
 
-        // 单词识别函数
-        void get_string()
+        // 枚举式模拟：求从每个状态出发读完s[0..n)后到达的状态，result[编号]为到达状态的行首下标。
+        // 所有状态同时走，每走一段就把到达同一状态的合并成一条，多数状态很快汇合或进入死状态，
+        // 实际只需要走少数几条
+        void chunkMap(const char *s, std::size_t n, std::vector<uint32_t> &result) const
         {
-            char c;
-            int z = 0;
-            c = getchar();
-            while ((c = getchar()) != EOF)
+            const uint32_t *t = table.data();
+            const unsigned char *cls = byteClass.data();
+            uint32_t rows = table.size() / classes;
+            std::vector<uint32_t> lane(rows);   //还在走的各条路径的当前状态，互不相同
+            std::vector<uint32_t> slot(rows);   //从第r个状态出发的路径现在是lane[slot[r]]
+            std::vector<int> where(rows, -1);
+            for (uint32_t r = 0; r < rows; r++)
             {
-                if (c != '#')
+                lane[r] = r * classes;
+                slot[r] = r;
+            }
+            for (std::size_t i = 0; i < n;)
+            {
+                std::size_t end = std::min(n, i + 4096);
+                for (uint32_t &state : lane)
                 {
-                    Str = Str + c;
-                } else
+                    uint32_t st = state;
+                    if (st == 0)
+                        continue;   //死状态不会再变
+                    std::size_t j = i;
+                    for (; j + 4 <= end; j += 4)
+                    {
+                        st = t[st + cls[(unsigned char) s[j]]];
+                        st = t[st + cls[(unsigned char) s[j + 1]]];
+                        st = t[st + cls[(unsigned char) s[j + 2]]];
+                        st = t[st + cls[(unsigned char) s[j + 3]]];
+                    }
+                    for (; j < end; j++)
+                        st = t[st + cls[(unsigned char) s[j]]];
+                    state = st;
+                }
+                i = end;
+
+                std::vector<uint32_t> merged, remap(lane.size());
+                for (std::size_t k = 0; k < lane.size(); k++)
                 {
-                    Str = Str + c;
-                    c = getchar();
-                    if (c == '\n')
+                    int &w = where[lane[k] / classes];
+                    if (w < 0)
                     {
-                        c = getchar();
-                        if (c == '\n') z++;
-                        else Str = Str + c;
+                        w = merged.size();
+                        merged.push_back(lane[k]);
                     }
+                    remap[k] = w;
                 }
-                if (z == 1) break;
+                for (uint32_t state : merged)
+                    where[state / classes] = -1;
+                for (uint32_t &k : slot)
+                    k = remap[k];
+                lane.swap(merged);
             }
+            result.resize(rows);
+            for (uint32_t r = 0; r < rows; r++)
+                result[r] = lane[slot[r]];
         }
 
-        void find_if()
+        // 多线程的match()：输入切成threads块，第0块从初态走，其余各块用chunkMap()求出
+        // 所有起始状态的结果，最后按块的顺序把各块的状态映射接起来
+        bool matchParallel(const char *s, std::size_t n, unsigned threads) const
         {
-            int n = Str.length();
-            std::string c = "X";
-            for (int i = 0; i < n; i++)
+            if (threads <= 1 || n < (std::size_t) threads << 16)
+                return match(s, n);
+            std::size_t chunk = n / threads;
+            std::vector<std::vector<uint32_t> > maps(threads);
+            std::vector<std::thread> workers;
+            for (unsigned c = 1; c < threads; c++)
             {
-                if (Str[i] != '#')
+                std::size_t begin = c * chunk, end = c + 1 == threads ? n : begin + chunk;
+                workers.push_back(std::thread([this, s, begin, end, &maps, c]()
+                                              {
+                                                  chunkMap(s + begin, end - begin, maps[c]);
+                                              }));
+            }
+            uint32_t state = start;
+            for (std::size_t i = 0; i < chunk && state != 0; i++)
+                state = table[state + byteClass[(unsigned char) s[i]]];
+            for (std::thread &worker : workers)
+                worker.join();
+            for (unsigned c = 1; c < threads; c++)
+                state = maps[c][state / classes];
+            return accepting[state / classes];
+        }
+
+        // 词法分析用的最长匹配：找s开头能被某条规则接受的最长前缀，长度放进len，返回规则编号，
+        // 一个前缀都不匹配时返回-1。同样长时先写的规则优先，这在子集构造时已经定好
+        int next(const char *s, std::size_t n, std::size_t &len) const
+        {
+            uint32_t state = start;
+            int found = -1;
+            len = 0;
+            for (std::size_t i = 0; i < n; i++)
+            {
+                state = table[state + byteClass[(unsigned char) s[i]]];
+                if (state == 0)
+                    break;
+                if (rule[state / classes] >= 0)
                 {
-                    std::string s;
-                    s = s + c;
-                    s = s + Str[i];
-                    c = dfa[s];
-                    // 字符是否存在
-                    if (c.length() > 0)
-                    {
-                        std::cout << Str[i] << std::endl;
-                    } else
-                    {
-                        std::cout << "error" << std::endl;
-                        while (Str[i] != '#')
-                        {
-                            i++;
-                        }
-                        c = "X";
-                    }
+                    found = rule[state / classes];
+                    len = i + 1;
                 }
-                    // 单个字符串结束判断
-                else
+            }
+            return found;
+        }
+
+        // 写进C++字符串字面量时的转义：\和"前加\，不可打印的字节写成三位八进制
+        static std::string escape_cpp(const std::string &text)
+        {
+            std::string out;
+            for (char c : text)
+            {
+                unsigned char b = c;
+                if (c == '"' || c == '\\')
+                {
+                    out += '\\';
+                    out += c;
+                } else if (b < 0x20 || b >= 0x7f)
+                {
+                    char buf[8];
+                    std::snprintf(buf, sizeof(buf), "\\%03o", b);
+                    out += buf;
+                } else
+                    out += c;
+            }
+            return out;
+        }
+
+        // 生成C++源码：把转换表、等价类和终态写成静态数组，外加与match()/next()相同的匹配函数，
+        // 放在名为name的namespace中。ruleNames不为空时再输出各规则的名字
+        void emit_cpp(std::ostream &os, const std::string &name, const std::vector<std::string> &ruleNames) const
+        {
+            uint32_t rows = table.size() / classes;
+            const char *type = table.size() <= 65536 ? "uint16_t" : "uint32_t";
+
+            os << "// Generated by regexAnalysis, do not edit.\n";
+            os << "#include <cstddef>\n#include <cstdint>\n\n";
+            os << "namespace " << name << "\n{\n";
+            os << "    static const uint32_t classes = " << classes << ";\n";
+            os << "    static const uint32_t start = " << start << ";\n\n";
+
+            os << "    static const unsigned char byteClass[256] = {";
+            for (int c = 0; c < 256; c++)
+                os << (c % 32 == 0 ? "\n            " : " ") << (int) byteClass[c] << ',';
+            os << "\n    };\n\n";
+
+            os << "    // table[state + byteClass[c]]，状态为行首下标，0为死状态\n";
+            os << "    static const " << type << " table[" << table.size() << "] = {";
+            for (std::size_t i = 0; i < table.size(); i++)
+                os << (i % classes == 0 ? "\n            " : " ") << table[i] << ',';
+            os << "\n    };\n\n";
+
+            os << "    // rule[state / classes]：终态对应的规则编号，非终态为-1\n";
+            os << "    static const int rule[" << rows << "] = {";
+            for (uint32_t i = 0; i < rows; i++)
+                os << (i % 16 == 0 ? "\n            " : " ") << (accepting[i] ? std::max(rule[i], 0) : -1) << ',';
+            os << "\n    };\n\n";
+
+            if (!ruleNames.empty())
+            {
+                os << "    static const char *const names[" << ruleNames.size() << "] = {";
+                for (const std::string &ruleName : ruleNames)
+                    os << "\n            \"" << escape_cpp(ruleName) << "\",";
+                os << "\n    };\n\n";
+            }
+
+            os << "    // 整段输入是否被接受\n"
+                  "    inline bool match(const char *s, std::size_t n)\n"
+                  "    {\n"
+                  "        uint32_t state = start;\n"
+                  "        for (std::size_t i = 0; i < n && state != 0; i++)\n"
+                  "            state = table[state + byteClass[(unsigned char) s[i]]];\n"
+                  "        return rule[state / classes] >= 0;\n"
+                  "    }\n\n";
+            os << "    // 最长匹配，返回规则编号和长度，不匹配时返回-1\n"
+                  "    inline int next(const char *s, std::size_t n, std::size_t &len)\n"
+                  "    {\n"
+                  "        uint32_t state = start;\n"
+                  "        int found = -1;\n"
+                  "        len = 0;\n"
+                  "        for (std::size_t i = 0; i < n; i++)\n"
+                  "        {\n"
+                  "            state = table[state + byteClass[(unsigned char) s[i]]];\n"
+                  "            if (state == 0)\n"
+                  "                break;\n"
+                  "            if (rule[state / classes] >= 0)\n"
+                  "            {\n"
+                  "                found = rule[state / classes];\n"
+                  "                len = i + 1;\n"
+                  "            }\n"
+                  "        }\n"
+                  "        return found;\n"
+                  "    }\n";
+            os << "}\n";
+        }
+
+        // 由table生成不锚定的查找表：对DFA状态的集合做子集构造，每读一个字节都把初态加回集合，
+        // 集合里有终态就说明有一个匹配在当前位置结束。查找表的0号状态是只含初态的集合
+        void creat_search()
+        {
+            std::map<std::vector<uint32_t>, uint32_t> index;
+            std::vector<std::vector<uint32_t> > sets(1, std::vector<uint32_t>(1, start));
+            index[sets[0]] = 0;
+            search.clear();
+            searchAccept.clear();
+            for (std::size_t i = 0; i < sets.size(); i++)
+            {
+                search.resize((i + 1) * classes, 0);
+                searchAccept.resize((i + 1) * classes, 0);
+                for (uint32_t state : sets[i])
                 {
-                    if (c[0] == 'Y')
+                    if (accepting[state / classes])
+                        searchAccept[i * classes] = 1;
+                }
+                for (uint32_t c = 0; c < classes; c++)
+                {
+                    std::vector<uint32_t> next(1, start);
+                    for (uint32_t state : sets[i])
                     {
-                        std::cout << "pass" << std::endl;
-                    } else
+                        if (table[state + c] != 0)
+                            next.push_back(table[state + c]);
+                    }
+                    std::sort(next.begin(), next.end());
+                    next.erase(std::unique(next.begin(), next.end()), next.end());
+                    std::map<std::vector<uint32_t>, uint32_t>::iterator it = index.find(next);
+                    if (it == index.end())
                     {
-                        std::cout << "error" << std::endl;
+                        it = index.insert(std::make_pair(next, (uint32_t) sets.size())).first;
+                        sets.push_back(next);
                     }
-                    c = 'X';
+                    search[i * classes + c] = it->second * classes;
                 }
             }
         }
-    };
 
-    void dfaIdentity()
-    {
-        DFA dfa;
+        // 在s[0..n)中找prefix第一次完整出现的位置；找不到时返回n-(prefix长度-1)，
+        // 跨块的部分留给DFA逐字节处理。先比较首尾两个字节筛出候选位置，SSE2下一次看16个位置
+        std::size_t findPrefix(const char *s, std::size_t n) const
+        {
+            std::size_t m = prefix.size();
+            if (n < m)
+                return 0;
+            if (m == 1)
+            {
+                const void *p = memchr(s, prefix[0], n);
+                return p ? (const char *) p - s : n;
+            }
+            std::size_t i = 0;
+#ifdef __SSE2__
+            const __m128i first = _mm_set1_epi8(prefix[0]);
+            const __m128i last = _mm_set1_epi8(prefix[m - 1]);
+            for (; i + m - 1 + 16 <= n; i += 16)
+            {
+                __m128i a = _mm_loadu_si128((const __m128i *) (s + i));
+                __m128i b = _mm_loadu_si128((const __m128i *) (s + i + m - 1));
+                unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+                for (; mask; mask &= mask - 1)
+                {
+                    std::size_t at = i + __builtin_ctz(mask);
+                    if (memcmp(s + at + 1, prefix.data() + 1, m - 2) == 0)
+                        return at;
+                }
+            }
+#endif
+            for (; i + m <= n; i++)
+            {
+                if (s[i] == prefix[0] && s[i + m - 1] == prefix[m - 1] && memcmp(s + i, prefix.data(), m) == 0)
+                    return i;
+            }
+            return n - m + 1;
+        }
+
+        // 查找s[0..n)这一块，state为跨块延续的查找状态，offset为块在整个输入中的位置。
+        // 有前缀时，查找状态回到0号(只含初态，没有进行到一半的匹配)就直接跳到前缀下一次出现的地方
+        long long scanBlock(const char *s, std::size_t n, uint32_t &state, long long offset, std::ostream &os) const
+        {
+            const uint32_t *t = search.data();
+            const unsigned char *cls = byteClass.data();
+            const unsigned char *acc = searchAccept.data();
+            long long count = 0;
+            for (std::size_t i = 0; i < n; i++)
+            {
+                if (state == 0 && !prefix.empty())
+                {
+                    i += findPrefix(s + i, n - i);
+                    if (i >= n)
+                        break;
+                }
+                state = t[state + cls[(unsigned char) s[i]]];
+                if (acc[state])
+                {
+                    os << offset + i + 1 << '\n';
+                    count++;
+                }
+            }
+            return count;
+        }
+
+        // 流式查找：按块read(2)读入，状态跨块延续，内存占用固定；
+        // 每个匹配结束的位置(从1开始的字节偏移)输出一行，返回匹配个数
+        long long scan(int fd, std::ostream &os) const
+        {
+            uint32_t state = 0;
+            long long count = 0;
+            readChunks(fd, [&](const char *s, std::size_t n, long long offset)
+            {
+                count += scanBlock(s, n, state, offset, os);
+            });
+            return count;
+        }
+
+        // 单词识别函数
+        void get_string()
+        {
+            char c;
+            int z = 0;
+            c = getchar();
+            while ((c = getchar()) != EOF)
+            {
+                if (c != '#')
+                {
+                    Str += c;
+                } else
+                {
+                    Str += c;
+                    c = getchar();
+                    if (c == '\n')
+                    {
+                        c = getchar();
+                        if (c == '\n') z++;
+                        else Str += c;
+                    }
+                }
+                if (z == 1) break;
+            }
+        }
+
+        void find_if()
+        {
+            int n = Str.length();
+            uint32_t c = start;
+            for (int i = 0; i < n; i++)
+            {
+                if (Str[i] != '#')
+                {
+                    c = table[c + byteClass[(unsigned char) Str[i]]];
+                    // 字符是否存在
+                    if (c != 0)
+                    {
+                        std::cout << Str[i] << '\n';
+                    } else
+                    {
+                        std::cout << "error" << '\n';
+                        while (Str[i] != '#')
+                        {
+                            i++;
+                        }
+                        c = start;
+                    }
+                }
+                    // 单个字符串结束判断
+                else
+                {
+                    if (accepting[c / classes])
+                    {
+                        std::cout << "pass" << '\n';
+                    } else
+                    {
+                        std::cout << "error" << '\n';
+                    }
+                    c = start;
+                }
+            }
+            std::cout.flush();
+        }
+    };
+
+    void dfaIdentity()
+    {
+        DFA dfa;
         // 录入信息方法
         dfa.creat_dfa_txt();
         dfa.get_string();
@@ -1747,8 +2458,1378 @@ namespace dfaIdentity
     }
 }
 
+namespace nfaIdentity
+{
+    // 稀疏集合：插入、查找、清空都是O(1)，遍历按插入顺序。dense放元素，sparse[s]为s在dense中的下标
+    class SparseSet
+    {
+    public:
+        std::vector<int> dense;
+        std::vector<int> sparse;
+        int size = 0;
+
+        void resize(int n)
+        {
+            dense.assign(n, 0);
+            sparse.assign(n, 0);
+            size = 0;
+        }
+
+        bool contains(int s) const
+        {
+            return sparse[s] < size && dense[sparse[s]] == s;
+        }
+
+        void insert(int s)
+        {
+            sparse[s] = size;
+            dense[size++] = s;
+        }
+
+        void clear()
+        {
+            size = 0;
+        }
+    };
+
+    // 把s及其经~边可达的状态加入set，stack为调用方提供的工作栈
+    void closure(const regex2nfa::NFA &nfa, SparseSet &set, std::vector<int> &stack, int s)
+    {
+        if (set.contains(s))
+            return;
+        set.insert(s);
+        stack.push_back(s);
+        while (!stack.empty())
+        {
+            int state = stack.back();
+            stack.pop_back();
+            for (const regex2nfa::Edge *e = nfa.edgeBegin(state); e != nfa.edgeEnd(state); e++)
+            {
+                if (e->symbol == regex2nfa::EPS && !set.contains(e->target))
+                {
+                    set.insert(e->target);
+                    stack.push_back(e->target);
+                }
+            }
+        }
+    }
+
+    // 不做确定化，直接在Thompson NFA上模拟(Pike VM)：当前活跃状态放在稀疏集合里，
+    // 每读一个字节把所有活跃状态往前推一步。每个字节最多访问每条边一次，时间与输入长度成线性，
+    // 内存只有两个状态集合，不会像子集构造那样随正则指数增长
+    class PikeVM
+    {
+    public:
+        regex2nfa::NFA nfa;
+        SparseSet clist, nlist;     // 当前和下一步的活跃状态
+        std::vector<int> stack;     // 求~闭包用的栈
+
+        void creat_vm(const regex2nfa::NFA &from)
+        {
+            nfa = from;
+            clist.resize(nfa.stateCount);
+            nlist.resize(nfa.stateCount);
+            stack.reserve(nfa.stateCount);
+        }
+
+        void addState(SparseSet &set, int s)
+        {
+            closure(nfa, set, stack, s);
+        }
+
+        // clist读入字节c后的状态放进nlist，然后交换两者
+        void step(unsigned char c)
+        {
+            nlist.clear();
+            for (int i = 0; i < clist.size; i++)
+            {
+                int state = clist.dense[i];
+                for (const regex2nfa::Edge *e = nfa.edgeBegin(state); e != nfa.edgeEnd(state); e++)
+                {
+                    if (nfa.matches(e->symbol, c))
+                        addState(nlist, e->target);
+                }
+            }
+            std::swap(clist, nlist);
+        }
+
+        // 整段输入是否被接受，语义同dfaIdentity::DFA::match()
+        bool match(const char *s, std::size_t n)
+        {
+            clist.clear();
+            addState(clist, nfa.start);
+            for (std::size_t i = 0; i < n && clist.size > 0; i++)
+                step((unsigned char) s[i]);
+            return clist.contains(nfa.accept);
+        }
+
+        // 流式查找，输出格式同dfaIdentity::DFA::scan()：每读一个字节都把初态加回集合，
+        // 集合里有终态就说明有一个匹配在当前位置结束
+        long long scan(int fd, std::ostream &os)
+        {
+            long long count = 0;
+            clist.clear();
+            addState(clist, nfa.start);
+            readChunks(fd, [&](const char *s, std::size_t n, long long offset)
+            {
+                for (std::size_t i = 0; i < n; i++)
+                {
+                    step((unsigned char) s[i]);
+                    addState(clist, nfa.start);
+                    if (clist.contains(nfa.accept))
+                    {
+                        os << offset + i + 1 << '\n';
+                        count++;
+                    }
+                }
+            });
+            return count;
+        }
+    };
+
+    struct SetHash
+    {
+        std::size_t operator()(const std::vector<int> &set) const
+        {
+            uint64_t h = 14695981039346656037ULL;
+            for (int state : set)
+                h = (h ^ (uint32_t) state) * 1099511628211ULL;
+            return h;
+        }
+    };
+
+    // 惰性DFA：不预先做子集构造，匹配时遇到还没算过的转换才由NFA求出下一个DFA状态并记进缓存。
+    // 缓存最多maxStates个状态，满了就整个清空，只从当前状态继续往下算，内存有上界；
+    // 输入只走到少数状态时，速度和预先构造的转换表一样
+    class LazyDFA
+    {
+    public:
+        regex2nfa::NFA nfa;
+        std::vector<unsigned char> byteClass;  //256项，字节 -> 等价类，见regex2nfa::NFA::byteClasses()
+        std::vector<unsigned char> member;     //每个等价类里的一个字节
+        uint32_t classes = 1;
+        bool unanchored = false;               //为真时每一步都把初态加回集合，用于scan()
+        std::size_t maxStates = 4096;          //缓存的状态个数上限
+        std::vector<int> table;                //转换表，格式同dfaIdentity::DFA::table，-1为还没算过
+        std::vector<unsigned char> accepting;  //accepting[state/classes]为1表示终态
+        std::vector<std::vector<int> > sets;   //每个DFA状态对应的NFA状态集合
+        std::unordered_map<std::vector<int>, int, SetHash> index;
+        int start = 0;                         //初态的行首下标，0为死状态
+        long long flushes = 0;                 //缓存清空的次数
+        SparseSet work;
+        std::vector<int> stack;
+
+        void creat_lazy(const regex2nfa::NFA &from, bool search)
+        {
+            nfa = from;
+            unanchored = search;
+            classes = nfa.byteClasses(byteClass);
+            member.assign(classes, 0);
+            for (int c = 255; c >= 0; c--)
+                member[byteClass[c]] = c;
+            work.resize(nfa.stateCount);
+            stack.reserve(nfa.stateCount);
+            flush();
+        }
+
+        // 清空缓存，只留下死状态和初态
+        void flush()
+        {
+            table.clear();
+            accepting.clear();
+            sets.clear();
+            index.clear();
+            addSet(std::vector<int>());
+            std::fill(table.begin(), table.end(), 0);
+            work.clear();
+            closure(nfa, work, stack, nfa.start);
+            start = addSet(collect());
+        }
+
+        // work中的NFA状态只留下有字节边的和终态，排好序作为DFA状态的键；
+        // 只经过~边的状态不影响之后的转换，去掉后同一个DFA状态不会因为它们被算成两个
+        std::vector<int> collect() const
+        {
+            std::vector<int> set;
+            for (int i = 0; i < work.size; i++)
+            {
+                int state = work.dense[i];
+                const regex2nfa::Edge *e = nfa.edgeBegin(state);
+                if (state == nfa.accept || (e != nfa.edgeEnd(state) && e->symbol != regex2nfa::EPS))
+                    set.push_back(state);
+            }
+            std::sort(set.begin(), set.end());
+            return set;
+        }
+
+        int addSet(const std::vector<int> &set)
+        {
+            int row = sets.size() * classes;
+            index[set] = row;
+            sets.push_back(set);
+            table.resize(table.size() + classes, -1);
+            accepting.push_back(std::binary_search(set.begin(), set.end(), nfa.accept));
+            return row;
+        }
+
+        // 求state经等价类c的下一状态并填进转换表；缓存满时先清空，这时返回的是新缓存里的状态
+        int transition(int state, uint32_t c)
+        {
+            work.clear();
+            for (int s : sets[state / classes])
+            {
+                for (const regex2nfa::Edge *e = nfa.edgeBegin(s); e != nfa.edgeEnd(s); e++)
+                {
+                    if (nfa.matches(e->symbol, member[c]))
+                        closure(nfa, work, stack, e->target);
+                }
+            }
+            if (unanchored)
+                closure(nfa, work, stack, nfa.start);
+            std::vector<int> set = collect();
+
+            std::unordered_map<std::vector<int>, int, SetHash>::iterator it = index.find(set);
+            if (it != index.end())
+            {
+                table[state + c] = it->second;
+                return it->second;
+            }
+            if (sets.size() >= maxStates)
+            {
+                flushes++;
+                flush();
+                it = index.find(set);
+                return it != index.end() ? it->second : addSet(set);
+            }
+            int next = addSet(set);
+            table[state + c] = next;
+            return next;
+        }
+
+        // 整段输入是否被接受，语义同dfaIdentity::DFA::match()
+        bool match(const char *s, std::size_t n)
+        {
+            const unsigned char *cls = byteClass.data();
+            int state = start;
+            for (std::size_t i = 0; i < n && state != 0; i++)
+            {
+                uint32_t c = cls[(unsigned char) s[i]];
+                int next = table[state + c];
+                state = next >= 0 ? next : transition(state, c);
+            }
+            return accepting[state / classes];
+        }
+
+        // 流式查找，输出格式同dfaIdentity::DFA::scan()，需要以search为真创建
+        long long scan(int fd, std::ostream &os)
+        {
+            const unsigned char *cls = byteClass.data();
+            int state = start;
+            long long count = 0;
+            readChunks(fd, [&](const char *s, std::size_t n, long long offset)
+            {
+                for (std::size_t i = 0; i < n; i++)
+                {
+                    uint32_t c = cls[(unsigned char) s[i]];
+                    int next = table[state + c];
+                    state = next >= 0 ? next : transition(state, c);
+                    if (accepting[state / classes])
+                    {
+                        os << offset + i + 1 << '\n';
+                        count++;
+                    }
+                }
+            });
+            return count;
+        }
+    };
+}
 
-int main()
+namespace dfaCache
 {
+    const uint32_t CACHE_VERSION = 2;   // 格式有变化时加一，旧文件会被当作没有缓存
+    const uint32_t CACHE_ENDIAN = 0x01020304;
+
+    // 缓存文件的格式：文件头后面依次是
+    // table[rows*classes] (uint32)、rule[rows] (int32)、accepting[rows] (uint8)、byteClass[256] (uint8)、
+    // prefix、pattern(正则的规范形式，用来排除哈希冲突)
+    // 整个文件按本机字节序直接映射使用，读入时只检查各项是否越界
+    struct Header
+    {
+        char magic[4];      // "RDFA"
+        uint32_t version;
+        uint32_t endian;    // 写入时的CACHE_ENDIAN，字节序不同的机器上读出来不相等
+        uint32_t classes;
+        uint64_t key;
+        uint32_t rows;
+        uint32_t start;
+        uint32_t prefixLength;
+        uint32_t patternLength;
+    };
+
+    // FNV-1a 64位哈希
+    uint64_t hash(const std::string &s)
+    {
+        uint64_t h = 14695981039346656037ULL;
+        for (char c : s)
+            h = (h ^ (unsigned char) c) * 1099511628211ULL;
+        return h;
+    }
+
+    // 键为key的缓存文件的路径：<dir>/<16位十六进制>.dfa
+    std::string path(const std::string &dir, uint64_t key)
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.dfa", (unsigned long long) key);
+        return dir + "/" + name;
+    }
+
+    // 只读映射的DFA：转换表等都直接指向映射的文件，多个进程映射同一个文件时共享物理页。
+    // match()和next()与dfaIdentity::DFA的同名函数相同；其他用法先copyTo()到DFA里
+    class MappedDFA
+    {
+    public:
+        const Header *header = nullptr;
+        const uint32_t *table = nullptr;
+        const int32_t *rule = nullptr;
+        const unsigned char *accepting = nullptr;
+        const unsigned char *byteClass = nullptr;
+        const char *prefix = nullptr;
+        void *data = nullptr;
+        std::size_t size = 0;
+
+        MappedDFA() = default;
+
+        MappedDFA(const MappedDFA &) = delete;
+
+        MappedDFA &operator=(const MappedDFA &) = delete;
+
+        ~MappedDFA()
+        {
+            close();
+        }
+
+        // 映射path，检查文件头、版本、长度和规范形式是否为pattern，再检查转换表和等价类都不越界，
+        // 损坏的文件不会让match()越界访问。失败时返回false
+        bool open(const std::string &path, const std::string &pattern)
+        {
+            close();
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                return false;
+            struct stat st;
+            if (fstat(fd, &st) != 0 || (std::size_t) st.st_size < sizeof(Header))
+            {
+                ::close(fd);
+                return false;
+            }
+            size = st.st_size;
+            data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (data == MAP_FAILED)
+            {
+                data = nullptr;
+                return false;
+            }
+
+            header = (const Header *) data;
+            uint64_t rows = header->rows, classes = header->classes;
+            uint64_t expect = sizeof(Header) + rows * classes * 4 + rows * 4 + rows + 256 + header->prefixLength +
+                              header->patternLength;
+            if (std::memcmp(header->magic, "RDFA", 4) != 0 || header->version != CACHE_VERSION ||
+                header->endian != CACHE_ENDIAN || header->key != hash(pattern) || classes == 0 || rows == 0 ||
+                expect != size || header->start >= rows * classes || header->start % classes != 0 ||
+                header->patternLength != pattern.size())
+            {
+                close();
+                return false;
+            }
+            const char *p = (const char *) data + sizeof(Header);
+            table = (const uint32_t *) p;
+            p += rows * classes * 4;
+            rule = (const int32_t *) p;
+            p += rows * 4;
+            accepting = (const unsigned char *) p;
+            p += rows;
+            byteClass = (const unsigned char *) p;
+            p += 256;
+            prefix = p;
+            p += header->prefixLength;
+            if (std::memcmp(p, pattern.data(), pattern.size()) != 0)
+            {
+                close();
+                return false;
+            }
+
+            //表里的每一项都必须是某一行的行首下标，等价类不能超过每行的长度
+            for (uint64_t i = 0; i < rows * classes; i++)
+            {
+                if (table[i] % classes != 0 || table[i] >= rows * classes)
+                {
+                    close();
+                    return false;
+                }
+            }
+            for (int c = 0; c < 256; c++)
+            {
+                if (byteClass[c] >= classes)
+                {
+                    close();
+                    return false;
+                }
+            }
+            for (uint64_t r = 0; r < rows; r++)
+            {
+                if (rule[r] < -1)
+                {
+                    close();
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        void close()
+        {
+            if (data)
+                munmap(data, size);
+            data = nullptr;
+            header = nullptr;
+            table = nullptr;
+            rule = nullptr;
+            accepting = nullptr;
+            byteClass = nullptr;
+            prefix = nullptr;
+            size = 0;
+        }
+
+        bool match(const char *s, std::size_t n) const
+        {
+            uint32_t state = header->start;
+            for (std::size_t i = 0; i < n && state != 0; i++)
+                state = table[state + byteClass[(unsigned char) s[i]]];
+            return accepting[state / header->classes];
+        }
+
+        int next(const char *s, std::size_t n, std::size_t &len) const
+        {
+            uint32_t state = header->start;
+            int found = -1;
+            len = 0;
+            for (std::size_t i = 0; i < n; i++)
+            {
+                state = table[state + byteClass[(unsigned char) s[i]]];
+                if (state == 0)
+                    break;
+                if (rule[state / header->classes] >= 0)
+                {
+                    found = rule[state / header->classes];
+                    len = i + 1;
+                }
+            }
+            return found;
+        }
+
+        // 复制到可以修改的DFA里，之后可以用creat_search()、scan()等
+        void copyTo(dfaIdentity::DFA &dfa) const
+        {
+            uint32_t rows = header->rows;
+            dfa.classes = header->classes;
+            dfa.start = header->start;
+            dfa.table.assign(table, table + rows * header->classes);
+            dfa.rule.assign(rule, rule + rows);
+            dfa.accepting.assign(accepting, accepting + rows);
+            dfa.byteClass.assign(byteClass, byteClass + 256);
+            dfa.prefix.assign(prefix, header->prefixLength);
+        }
+    };
+
+    // 把规范形式为pattern的DFA写成缓存文件：先写到临时文件再rename，别的进程不会读到写了一半的文件
+    bool save(const std::string &path, const std::string &pattern, const dfaIdentity::DFA &dfa)
+    {
+        Header header;
+        std::memcpy(header.magic, "RDFA", 4);
+        header.version = CACHE_VERSION;
+        header.endian = CACHE_ENDIAN;
+        header.classes = dfa.classes;
+        header.key = hash(pattern);
+        header.rows = dfa.table.size() / dfa.classes;
+        header.start = dfa.start;
+        header.prefixLength = dfa.prefix.size();
+        header.patternLength = pattern.size();
+
+        std::string tmp = path + ".tmp" + std::to_string(getpid());
+        std::ofstream of(tmp, std::ios::binary);
+        of.write((const char *) &header, sizeof(header));
+        of.write((const char *) dfa.table.data(), dfa.table.size() * sizeof(uint32_t));
+        for (uint32_t r = 0; r < header.rows; r++)
+        {
+            int32_t rule = r < dfa.rule.size() ? dfa.rule[r] : -1;
+            of.write((const char *) &rule, sizeof(rule));
+        }
+        of.write((const char *) dfa.accepting.data(), header.rows);
+        of.write((const char *) dfa.byteClass.data(), 256);
+        of.write(dfa.prefix.data(), dfa.prefix.size());
+        of.write(pattern.data(), pattern.size());
+        of.close();
+        if (!of || std::rename(tmp.c_str(), path.c_str()) != 0)
+        {
+            std::remove(tmp.c_str());
+            return false;
+        }
+        return true;
+    }
+}
+
+namespace regexAnalysis
+{
+    // 编译各阶段的统计：耗时、阶段结束时的规模和进程到此为止的内存峰值。
+    // STATS_ON为false时stage()什么都不做
+    class CompileStats
+    {
+    public:
+        struct Stage
+        {
+            std::string name;
+            double ms;
+            std::vector<std::pair<const char *, std::size_t> > counts;  //如states、edges、tokens
+            long maxrssKb;
+        };
+
+        std::string regex;      //compileRules()时为空
+        std::size_t rules = 1;
+        bool cached = false;    //是否从编译缓存读入
+        std::vector<Stage> stages;
+
+        CompileStats() : last(std::chrono::steady_clock::now())
+        {
+        }
+
+        // 记录从上一个阶段结束(或构造)到现在的这一阶段
+        void stage(const char *name, std::initializer_list<std::pair<const char *, std::size_t> > counts)
+        {
+            if (!STATS_ON)
+                return;
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            struct rusage usage;
+            getrusage(RUSAGE_SELF, &usage);
+            Stage s;
+            s.name = name;
+            s.ms = std::chrono::duration<double, std::milli>(now - last).count();
+            s.counts.assign(counts.begin(), counts.end());
+            s.maxrssKb = usage.ru_maxrss;
+            stages.push_back(s);
+            last = std::chrono::steady_clock::now();
+        }
+
+        // 输出为一行JSON
+        void output(std::ostream &os) const
+        {
+            if (!STATS_ON)
+                return;
+            double total = 0;
+            for (const Stage &s : stages)
+                total += s.ms;
+            os << "{\"regex\":\"" << escape(regex) << "\",\"rules\":" << rules
+               << ",\"cached\":" << (cached ? "true" : "false") << ",\"total_ms\":" << total << ",\"stages\":[";
+            for (std::size_t i = 0; i < stages.size(); i++)
+            {
+                const Stage &s = stages[i];
+                os << (i ? "," : "") << "{\"stage\":\"" << s.name << "\",\"ms\":" << s.ms;
+                for (const std::pair<const char *, std::size_t> &count : s.counts)
+                    os << ",\"" << count.first << "\":" << count.second;
+                os << ",\"maxrss_kb\":" << s.maxrssKb << '}';
+            }
+            os << "]}" << '\n';
+        }
+
+    private:
+        std::chrono::steady_clock::time_point last;
+
+        // JSON字符串转义，正则不一定是UTF-8，控制字符和128以上的字节都写成\u00XX
+        static std::string escape(const std::string &s)
+        {
+            std::string out;
+            for (char c : s)
+            {
+                unsigned char b = c;
+                if (c == '"' || c == '\\')
+                {
+                    out += '\\';
+                    out += c;
+                } else if (b < 0x20 || b >= 0x80)
+                {
+                    char buf[8];
+                    std::snprintf(buf, sizeof(buf), "\\u%04x", b);
+                    out += buf;
+                } else
+                    out += c;
+            }
+            return out;
+        }
+    };
+
+    // 化简过程中的状态数：各子集大小之和
+    std::size_t splitSize(const dfaSimplify::DFA &dfa)
+    {
+        std::size_t n = 0;
+        for (const std::vector<int> &group : dfa.splitStates)
+            n += group.size();
+        return n;
+    }
+
+    // 在内存中依次完成 regex2nfa -> nfa2dfa -> dfaSimplify，结果直接交给dfaIdentity，
+    // 各阶段之间不再经过tmp_*.txt文件。设置了CACHE_DIR时，先按规范形式的哈希找缓存文件，
+    // 找到就直接读入，否则编译完写进缓存。STATS_ON时各阶段的统计输出到标准错误。
+    // 正则被拒绝时(见regex2nfa::Regex2Nfa::insertExplicit())在标准错误输出原因并返回false
+    bool compile(const std::string &regex, dfaIdentity::DFA &matcher)
+    {
+        CompileStats stats;
+        stats.regex = regex;
+        regex2nfa::Regex2Nfa regex2nfa;
+        regex2nfa.setInput(regex);
+        if (!regex2nfa.insertExplicit())
+        {
+            std::cerr << "regex error: " << regex2nfa.getError() << '\n';
+            return false;
+        }
+        stats.stage("insertExplicit", {{"tokens", regex2nfa.getTokens().size()}});
+        regex2nfa.convertToPostfix();
+        stats.stage("convertToPostfix", {{"tokens", regex2nfa.getPostfix().size()}});
+
+        std::string pattern, path;
+        if (CACHE_DIR)
+        {
+            pattern = regex2nfa.normalized();
+            path = dfaCache::path(CACHE_DIR, dfaCache::hash(pattern));
+            dfaCache::MappedDFA cached;
+            if (cached.open(path, pattern))
+            {
+                cached.copyTo(matcher);
+                stats.cached = true;
+                stats.stage("cacheLoad", {{"states", cached.header->rows}, {"bytes", cached.size}});
+                stats.output(std::cerr);
+                return true;
+            }
+        }
+
+        regex2nfa.constructToNFA();
+        const regex2nfa::NFA &nfa = regex2nfa.getNFA();
+        stats.stage("constructToNFA", {{"states", (std::size_t) nfa.stateCount}, {"edges", nfa.edges.size()}});
+
+        struct nfa2dfa::NFA nfam;
+        nfa2dfa::input(nfa, nfam);
+        struct nfa2dfa::DFA dfam = nfa2dfa::NFAtoDFA(nfam);
+        stats.stage("NFAtoDFA", {{"states", dfam.state.size()}, {"edges", dfam.transfunc.size()}});
+
+        dfaSimplify::DFA simplified;
+        simplified.input(dfam);
+        simplified.elimDeadState();
+        stats.stage("elimDeadState", {{"states", splitSize(simplified)}, {"edges", simplified.dfaStateList.size()}});
+        simplified.simple();
+        stats.stage("simple", {{"states", simplified.splitStates.size()}, {"edges", simplified.dfaStateList.size()}});
+        simplified.merge();
+        stats.stage("merge", {{"states", simplified.splitStates.size()}, {"edges", simplified.resultList.size()}});
+
+        if (CHECK_ON)
+        {
+            regex2nfa.printPostfixStrByChar();
+            nfa2dfa::DFAoutput(dfam);
+            simplified.output(std::cout);
+        }
+
+        matcher.creat_dfa(simplified);
+        matcher.prefix = regex2nfa.literalPrefix();
+        stats.stage("creat_dfa", {{"states", matcher.table.size() / matcher.classes}, {"classes", matcher.classes}});
+        if (CACHE_DIR)
+            dfaCache::save(path, pattern, matcher);
+        stats.output(std::cerr);
+        return true;
+    }
+
+    // 只做Thompson构造，不确定化，结果交给nfaIdentity的PikeVM或LazyDFA；正则被拒绝时同compile()
+    bool compileNFA(const std::string &regex, regex2nfa::NFA &nfa)
+    {
+        regex2nfa::Regex2Nfa regex2nfa;
+        regex2nfa.setInput(regex);
+        if (!regex2nfa.insertExplicit())
+        {
+            std::cerr << "regex error: " << regex2nfa.getError() << '\n';
+            return false;
+        }
+        regex2nfa.convertToPostfix();
+        regex2nfa.constructToNFA();
+        if (CHECK_ON)
+            regex2nfa.printPostfixStrByChar();
+        nfa = regex2nfa.getNFA();
+        return true;
+    }
+
+    // 词法规则：名字和正则
+    struct Rule
+    {
+        std::string name;
+        std::string regex;
+    };
+
+    // 规则文件每行为"名字 正则"，空行和#开头的行忽略，行的先后就是规则的优先级
+    std::vector<Rule> readRules(std::istream &is)
+    {
+        std::vector<Rule> rules;
+        std::string line;
+        while (getline(is, line))
+        {
+            std::istringstream in(line);
+            Rule rule;
+            if (!(in >> rule.name) || rule.name[0] == '#' || !(in >> rule.regex))
+                continue;
+            rules.push_back(rule);
+        }
+        return rules;
+    }
+
+    // 多条规则合成一个NFA：新的初态经~边到各规则NFA的初态，各规则的状态依次往后编号，
+    // 字符类也合到一起，终态标记为规则编号；之后和compile()一样只做一次确定化和化简。
+    // 有规则的正则被拒绝时输出规则名和原因并返回false
+    bool compileRules(const std::vector<Rule> &rules, dfaIdentity::DFA &lexer)
+    {
+        CompileStats stats;
+        stats.rules = rules.size();
+        regex2nfa::NFA all;
+        std::map<int, int> tags;
+        all.start = all.newState();
+        for (std::size_t r = 0; r < rules.size(); r++)
+        {
+            regex2nfa::Regex2Nfa regex2nfa;
+            regex2nfa.setInput(rules[r].regex);
+            if (!regex2nfa.insertExplicit())
+            {
+                std::cerr << "regex error in rule " << rules[r].name << ": " << regex2nfa.getError() << '\n';
+                return false;
+            }
+            regex2nfa.convertToPostfix();
+            regex2nfa.constructToNFA();
+
+            const regex2nfa::NFA &part = regex2nfa.getNFA();
+            int base = all.stateCount;
+            all.stateCount += part.stateCount;
+            for (int state = 0; state < part.stateCount; state++)
+            {
+                for (const regex2nfa::Edge *e = part.edgeBegin(state); e != part.edgeEnd(state); e++)
+                {
+                    int symbol = e->symbol < 256 ? e->symbol : all.addSet(part.sets[e->symbol - 256]);
+                    all.addEdge(base + state, symbol, base + e->target);
+                }
+            }
+            all.addEdge(all.start, regex2nfa::EPS, base + part.start);
+            tags[base + part.accept] = r;
+        }
+        all.finish();
+        //各规则的insertExplicit、convertToPostfix也算在这一阶段里
+        stats.stage("constructToNFA", {{"states", (std::size_t) all.stateCount}, {"edges", all.edges.size()}});
+
+        struct nfa2dfa::NFA nfam;
+        nfa2dfa::input(all, nfam);
+        nfam.tags = tags;
+
+        struct nfa2dfa::DFA dfam = nfa2dfa::NFAtoDFA(nfam);
+        stats.stage("NFAtoDFA", {{"states", dfam.state.size()}, {"edges", dfam.transfunc.size()}});
+        dfaSimplify::DFA simplified;
+        simplified.input(dfam);
+        simplified.elimDeadState();
+        stats.stage("elimDeadState", {{"states", splitSize(simplified)}, {"edges", simplified.dfaStateList.size()}});
+        simplified.simple();
+        stats.stage("simple", {{"states", simplified.splitStates.size()}, {"edges", simplified.dfaStateList.size()}});
+        simplified.merge();
+        stats.stage("merge", {{"states", simplified.splitStates.size()}, {"edges", simplified.resultList.size()}});
+
+        if (CHECK_ON)
+            simplified.output(std::cout);
+
+        lexer.creat_dfa(simplified);
+        stats.stage("creat_dfa", {{"states", lexer.table.size() / lexer.classes}, {"classes", lexer.classes}});
+        stats.output(std::cerr);
+        return true;
+    }
+
+    // 用规则切分text，每个单词输出一行"规则名 单词"；没有规则匹配的空白直接跳过，
+    // 其他字符报错后跳过一个字节。返回出错的次数
+    int tokenize(const std::vector<Rule> &rules, const dfaIdentity::DFA &lexer, const std::string &text,
+                 std::ostream &os)
+    {
+        int errors = 0;
+        std::size_t pos = 0, len = 0;
+        while (pos < text.size())
+        {
+            int r = lexer.next(text.data() + pos, text.size() - pos, len);
+            if (r >= 0)
+            {
+                os << rules[r].name << ' ' << text.substr(pos, len) << '\n';
+                pos += len;
+                continue;
+            }
+            if (!isspace((unsigned char) text[pos]))
+            {
+                os << "error " << pos << ' ' << text[pos] << '\n';
+                errors++;
+            }
+            pos++;
+        }
+        return errors;
+    }
+
+    // 基准测试用的线性同余随机数，每次都从同一个种子开始，各次运行的数据相同
+    struct Random
+    {
+        unsigned int seed = 12345;
+
+        unsigned int next()
+        {
+            seed = seed * 1103515245 + 12345;
+            return seed >> 16;
+        }
+    };
+
+    // size个从alphabet中随机取的字符
+    std::string randomText(std::size_t size, const std::string &alphabet, Random &random)
+    {
+        std::string text(size, ' ');
+        for (char &c : text)
+            c = alphabet[random.next() % alphabet.size()];
+        return text;
+    }
+
+    // size个随机的a、b
+    std::string randomText(std::size_t size)
+    {
+        Random random;
+        return randomText(size, "ab", random);
+    }
+
+    // 化简的规模测试：构造n个状态、字母表a b c d的DFA，状态i与i+n/2等价，
+    // 只对simple()计时
+    void benchMinimize()
+    {
+        for (int n = 1000; n <= 256000; n *= 4)
+        {
+            int h = n / 2;
+            nfa2dfa::DFA dfam;
+            for (int i = 0; i < n; i++)
+            {
+                int r = i % h;
+                int next[4] = {(r + 1) % h, (2 * r) % h, (r * 7 + 3) % h, r / 2};
+                dfam.state.insert(i);
+                if (r % 5 == 0)
+                    dfam.accept.insert(i);
+                for (int k = 0; k < 4; k++)
+                {
+                    nfa2dfa::trans t;
+                    t.start = i;
+                    t.receive = 'a' + k;
+                    t.end = next[k] + (i * (k + 3) / 7 % 2) * h;
+                    dfam.transfunc.push_back(t);
+                }
+            }
+
+            dfaSimplify::DFA simplified;
+            simplified.input(dfam);
+            std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+            simplified.simple();
+            std::chrono::duration<double, std::milli> cost = std::chrono::steady_clock::now() - begin;
+            std::cout << "minimize states=" << n << " blocks=" << simplified.splitStates.size()
+                      << " time=" << cost.count() << "ms" << '\n';
+        }
+    }
+
+    // 匹配吞吐量测试：(a|b)*abb在随机a/b输入上，转换表对比原来按"状态名+字母"查std::map的做法
+    void benchMatch()
+    {
+        dfaIdentity::DFA matcher;
+        compile("(a|b)*abb", matcher);
+
+        std::string text = randomText(64 << 20);
+        text.replace(text.size() - 3, 3, "abb");
+
+        double best = 1e30;
+        bool result = false;
+        for (int round = 0; round < 5; round++)
+        {
+            std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+            result = matcher.match(text.data(), text.size());
+            std::chrono::duration<double> cost = std::chrono::steady_clock::now() - begin;
+            best = std::min(best, cost.count());
+        }
+        std::cout << "match table bytes=" << text.size() << " result=" << result
+                  << " speed=" << text.size() / best / 1e6 << "MB/s"
+                  << " classes=" << matcher.classes << " tableBytes=" << matcher.table.size() * sizeof(uint32_t)
+                  << " (256 columns: " << matcher.table.size() / matcher.classes * 256 * sizeof(uint32_t) << ")" << '\n';
+
+        //原来的做法：std::map<std::string, std::string>，键为状态名加字母
+        std::map<std::string, std::string> dfa;
+        for (uint32_t state = matcher.classes; state < matcher.table.size(); state += matcher.classes)
+            for (int c = 0; c < 256; c++)
+                if (matcher.table[state + matcher.byteClass[c]])
+                    dfa[std::to_string(state) + char(c)] = std::to_string(matcher.table[state + matcher.byteClass[c]]);
+        std::size_t n = 4 << 20;
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        std::string c = std::to_string(matcher.start);
+        for (std::size_t i = 0; i < n && c.length() > 0; i++)
+            c = dfa[c + text[i]];
+        std::chrono::duration<double> cost = std::chrono::steady_clock::now() - begin;
+        std::cout << "match map bytes=" << n << " state=" << c
+                  << " speed=" << n / cost.count() / 1e6 << "MB/s" << '\n';
+    }
+
+    // Thompson构造的规模测试：n个关键字的并，只对insertExplicit()到constructToNFA()计时
+    void benchThompson()
+    {
+        for (int n = 1000; n <= 64000; n *= 4)
+        {
+            std::string regex;
+            for (int i = 0; i < n; i++)
+            {
+                if (i)
+                    regex += '|';
+                regex += "kw";
+                for (int v = i; v; v /= 26)
+                    regex += char('a' + v % 26);
+            }
+
+            regex2nfa::Regex2Nfa regex2nfa;
+            regex2nfa.setInput(regex);
+            std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+            regex2nfa.insertExplicit();
+            regex2nfa.convertToPostfix();
+            regex2nfa.constructToNFA();
+            std::chrono::duration<double, std::milli> cost = std::chrono::steady_clock::now() - begin;
+            std::cout << "thompson keywords=" << n << " length=" << regex.size()
+                      << " states=" << regex2nfa.getNFA().stateCount
+                      << " time=" << cost.count() << "ms" << '\n';
+        }
+    }
+
+    // 子集构造会爆炸的(a|b)*a(a|b)^n：DFA的状态数为2^(n+1)。分别对编译和匹配计时，
+    // 对比compile()+DFA::match()与compileNFA()+PikeVM::match()、LazyDFA::match()
+    void benchPike()
+    {
+        std::string text = randomText(1 << 20);
+
+        for (int n = 4; n <= 16; n += 4)
+        {
+            std::string regex = "(a|b)*a";
+            for (int i = 0; i < n; i++)
+                regex += "(a|b)";
+
+            std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+            dfaIdentity::DFA dfa;
+            compile(regex, dfa);
+            std::chrono::duration<double, std::milli> build = std::chrono::steady_clock::now() - begin;
+            begin = std::chrono::steady_clock::now();
+            bool result = dfa.match(text.data(), text.size());
+            std::chrono::duration<double> cost = std::chrono::steady_clock::now() - begin;
+            std::cout << "pike n=" << n << " dfa states=" << dfa.table.size() / dfa.classes - 1
+                      << " compile=" << build.count() << "ms result=" << result
+                      << " speed=" << text.size() / cost.count() / 1e6 << "MB/s" << '\n';
+
+            begin = std::chrono::steady_clock::now();
+            nfaIdentity::PikeVM vm;
+            regex2nfa::NFA nfa;
+            compileNFA(regex, nfa);
+            vm.creat_vm(nfa);
+            build = std::chrono::steady_clock::now() - begin;
+            begin = std::chrono::steady_clock::now();
+            result = vm.match(text.data(), text.size());
+            cost = std::chrono::steady_clock::now() - begin;
+            std::cout << "pike n=" << n << " nfa states=" << vm.nfa.stateCount
+                      << " compile=" << build.count() << "ms result=" << result
+                      << " speed=" << text.size() / cost.count() / 1e6 << "MB/s" << '\n';
+
+            begin = std::chrono::steady_clock::now();
+            nfaIdentity::LazyDFA lazy;
+            lazy.maxStates = 1024;
+            compileNFA(regex, nfa);
+            lazy.creat_lazy(nfa, false);
+            build = std::chrono::steady_clock::now() - begin;
+            begin = std::chrono::steady_clock::now();
+            result = lazy.match(text.data(), text.size());
+            cost = std::chrono::steady_clock::now() - begin;
+            std::cout << "pike n=" << n << " lazy cached=" << lazy.sets.size() << " flushes=" << lazy.flushes
+                      << " compile=" << build.count() << "ms result=" << result
+                      << " speed=" << text.size() / cost.count() / 1e6 << "MB/s" << '\n';
+        }
+    }
+
+    // 稀疏匹配的查找：64MiB随机小写单词组成的日志，每64KiB出现一次"ERROR 数字"，
+    // 对比用字面前缀跳读和逐字节走查找表
+    void benchScan()
+    {
+        Random random;
+        std::string text = randomText(64 << 20, "abcdefghijklmnopqrstuvwxyz    \n\n", random);
+        for (std::size_t i = 1000; i + 16 < text.size(); i += 65536)
+            text.replace(i, 9, "ERROR 42 ");
+
+        const char *regexes[] = {"ERROR [0-9]+", "[a-z]+ERROR", "(ERROR|WARN) \\d+"};
+        for (const char *regex : regexes)
+        {
+            dfaIdentity::DFA dfa;
+            compile(regex, dfa);
+            dfa.creat_search();
+            std::string prefix = dfa.prefix;
+            for (int round = 0; round < 2; round++)
+            {
+                dfa.prefix = round == 0 ? prefix : std::string();
+                std::ostringstream os;
+                uint32_t state = 0;
+                std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+                long long count = dfa.scanBlock(text.data(), text.size(), state, 0, os);
+                std::chrono::duration<double> cost = std::chrono::steady_clock::now() - begin;
+                std::cout << "scan regex=" << regex << " prefix=\"" << dfa.prefix << "\" matches=" << count
+                          << " speed=" << text.size() / cost.count() / 1e6 << "MB/s" << '\n';
+            }
+        }
+    }
+
+    // 多线程匹配：256MiB随机a/b输入上的(a|b)*abb，对比match()和不同线程数的matchParallel()
+    void benchParallel()
+    {
+        dfaIdentity::DFA matcher;
+        compile("(a|b)*abb", matcher);
+
+        std::string text = randomText(256 << 20);
+        text.replace(text.size() - 3, 3, "abb");
+
+        unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+        std::vector<unsigned> counts(1, 1);
+        for (unsigned threads = 2; threads <= std::max(cores, 4u); threads *= 2)
+            counts.push_back(threads);
+        for (unsigned threads : counts)
+        {
+            std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+            bool result = matcher.matchParallel(text.data(), text.size(), threads);
+            std::chrono::duration<double> cost = std::chrono::steady_clock::now() - begin;
+            std::cout << "parallel threads=" << threads << " cores=" << cores << " result=" << result
+                      << " speed=" << text.size() / cost.count() / 1e6 << "MB/s" << '\n';
+        }
+    }
+
+    // 批量匹配：64MiB随机a/b串匹配(a|b)*abb，串长分别为4到19和64到127，
+    // 对比逐个match()和matchBatch()
+    void benchBatch()
+    {
+        dfaIdentity::DFA matcher;
+        compile("(a|b)*abb", matcher);
+
+        int shortest[] = {4, 64};
+        for (int low : shortest)
+        {
+            std::string data;
+            std::vector<std::size_t> offsets(1, 0);
+            Random random;
+            while (data.size() < (64 << 20))
+            {
+                int len = low + random.next() % (low == 4 ? 16 : 64);
+                data += randomText(len, "ab", random);
+                offsets.push_back(data.size());
+            }
+            std::size_t count = offsets.size() - 1;
+
+            std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+            std::size_t passed = 0;
+            for (std::size_t k = 0; k < count; k++)
+                passed += matcher.match(data.data() + offsets[k], offsets[k + 1] - offsets[k]);
+            std::chrono::duration<double> cost = std::chrono::steady_clock::now() - begin;
+            std::cout << "batch single length>=" << low << " strings=" << count << " passed=" << passed
+                      << " speed=" << count / cost.count() / 1e6 << "M/s" << '\n';
+
+            std::vector<uint64_t> bitmap;
+            begin = std::chrono::steady_clock::now();
+            matcher.matchBatch(data.data(), offsets.data(), count, bitmap);
+            cost = std::chrono::steady_clock::now() - begin;
+            passed = 0;
+            for (uint64_t word : bitmap)
+                passed += __builtin_popcountll(word);
+            std::cout << "batch lanes length>=" << low << " strings=" << count << " passed=" << passed
+                      << " speed=" << count / cost.count() / 1e6 << "M/s" << '\n';
+        }
+    }
+
+    // 编译缓存：同一个关键字并集，对比完整编译、写缓存文件、映射缓存文件和复制到DFA的耗时，
+    // 并检查映射后的匹配结果与编译结果相同
+    void benchCache()
+    {
+        //3000个随机的小写单词，长度4~11
+        std::vector<std::string> words;
+        std::string regex;
+        Random random;
+        for (int i = 0; i < 3000; i++)
+        {
+            std::string word = randomText(4 + random.next() % 8, "abcdefghijklmnopqrstuvwxyz", random);
+            words.push_back(word);
+            if (i)
+                regex += '|';
+            regex += word;
+        }
+        const char *dir = CACHE_DIR;
+        CACHE_DIR = nullptr;
+
+        dfaIdentity::DFA compiled;
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        compile(regex, compiled);
+        std::chrono::duration<double, std::milli> cost = std::chrono::steady_clock::now() - begin;
+        std::cout << "cache compile states=" << compiled.table.size() / compiled.classes
+                  << " time=" << cost.count() << "ms" << '\n';
+
+        std::string path = "tmp_bench_cache.dfa";
+        begin = std::chrono::steady_clock::now();
+        dfaCache::save(path, regex, compiled);
+        cost = std::chrono::steady_clock::now() - begin;
+        std::cout << "cache save time=" << cost.count() << "ms" << '\n';
+
+        dfaCache::MappedDFA mapped;
+        begin = std::chrono::steady_clock::now();
+        bool opened = mapped.open(path, regex);
+        cost = std::chrono::steady_clock::now() - begin;
+        std::cout << "cache open ok=" << opened << " bytes=" << mapped.size << " time=" << cost.count() << "ms" << '\n';
+
+        dfaIdentity::DFA loaded;
+        begin = std::chrono::steady_clock::now();
+        if (opened)
+            mapped.copyTo(loaded);
+        cost = std::chrono::steady_clock::now() - begin;
+        std::cout << "cache copy time=" << cost.count() << "ms" << '\n';
+
+        int differ = 0;
+        for (std::size_t i = 0; i < words.size() * 2 && opened; i++)
+        {
+            //一半是关键字本身，一半是去掉最后一个字符的
+            std::string word = words[i / 2].substr(0, words[i / 2].size() - i % 2);
+            bool expect = compiled.match(word.data(), word.size());
+            differ += mapped.match(word.data(), word.size()) != expect;
+            differ += loaded.match(word.data(), word.size()) != expect;
+        }
+        std::cout << "cache verify differ=" << differ << '\n';
+        std::remove(path.c_str());
+        CACHE_DIR = dir;
+    }
+
+    // regexAnalysis bench [名字]：不给名字时跑全部
+    void bench(const std::string &which)
+    {
+        if (which.empty() || which == "minimize")
+            benchMinimize();
+        if (which.empty() || which == "match")
+            benchMatch();
+        if (which.empty() || which == "thompson")
+            benchThompson();
+        if (which.empty() || which == "pike")
+            benchPike();
+        if (which.empty() || which == "scan")
+            benchScan();
+        if (which.empty() || which == "parallel")
+            benchParallel();
+        if (which.empty() || which == "batch")
+            benchBatch();
+        if (which.empty() || which == "cache")
+            benchCache();
+    }
+}
+
+
+int main(int argc, char *argv[])
+{
+    CACHE_DIR = getenv("REGEX_CACHE_DIR");
+    const char *stats = getenv("REGEX_STATS");
+    STATS_ON = stats && *stats && std::strcmp(stats, "0") != 0;
+    if (argc > 1 && std::strcmp(argv[1], "bench") == 0)
+    {
+        regexAnalysis::bench(argc > 2 ? argv[2] : "");
+        return 0;
+    }
+    if (argc > 2 && std::strcmp(argv[1], "lex") == 0)
+    {
+        // regexAnalysis lex <规则文件> [file]：按规则切分文件或标准输入
+        std::ifstream ruleFile(argv[2]);
+        std::vector<regexAnalysis::Rule> rules = regexAnalysis::readRules(ruleFile);
+        if (rules.empty())
+        {
+            std::cerr << "no rules in " << argv[2] << '\n';
+            return 1;
+        }
+        dfaIdentity::DFA lexer;
+        if (!regexAnalysis::compileRules(rules, lexer))
+            return 1;
+
+        std::ifstream file;
+        if (argc > 3)
+        {
+            file.open(argv[3], std::ios::binary);
+            if (!file.is_open())
+            {
+                std::cerr << "could not open " << argv[3] << '\n';
+                return 1;
+            }
+        }
+        std::istream &in = argc > 3 ? file : std::cin;
+        std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        return regexAnalysis::tokenize(rules, lexer, text, std::cout) == 0 ? 0 : 1;
+    }
+    if (argc > 2 && (std::strcmp(argv[1], "gen") == 0 || std::strcmp(argv[1], "gen-lex") == 0))
+    {
+        // regexAnalysis gen <regex> [名字] / gen-lex <规则文件> [名字]：把化简后的DFA输出为C++源码
+        dfaIdentity::DFA dfa;
+        std::vector<std::string> names;
+        if (std::strcmp(argv[1], "gen") == 0)
+        {
+            if (!regexAnalysis::compile(argv[2], dfa))
+                return 1;
+        }
+        else
+        {
+            std::ifstream ruleFile(argv[2]);
+            std::vector<regexAnalysis::Rule> rules = regexAnalysis::readRules(ruleFile);
+            if (rules.empty())
+            {
+                std::cerr << "no rules in " << argv[2] << '\n';
+                return 1;
+            }
+            if (!regexAnalysis::compileRules(rules, dfa))
+                return 1;
+            for (const regexAnalysis::Rule &rule : rules)
+                names.push_back(rule.name);
+        }
+        dfa.emit_cpp(std::cout, argc > 3 ? argv[3] : "regex_dfa", names);
+        return 0;
+    }
+    if (argc > 2 && std::strcmp(argv[1], "batch") == 0)
+    {
+        // regexAnalysis batch <regex> [file]：文件或标准输入的每一行是一个单词，每行输出pass或error
+        dfaIdentity::DFA dfa;
+        if (!regexAnalysis::compile(argv[2], dfa))
+            return 1;
+        std::ifstream file;
+        if (argc > 3)
+        {
+            file.open(argv[3], std::ios::binary);
+            if (!file.is_open())
+            {
+                std::cerr << "could not open " << argv[3] << '\n';
+                return 1;
+            }
+        }
+        std::istream &in = argc > 3 ? file : std::cin;
+        std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        //去掉换行，各行首尾相接，bounds[k]为第k行的开始
+        std::string words;
+        std::vector<std::size_t> bounds(1, 0);
+        for (std::size_t i = 0; i < text.size(); i++)
+        {
+            if (text[i] == '\n')
+                bounds.push_back(words.size());
+            else
+                words += text[i];
+        }
+        if (!text.empty() && text.back() != '\n')
+            bounds.push_back(words.size());
+        std::vector<uint64_t> bitmap;
+        dfa.matchBatch(words.data(), bounds.data(), bounds.size() - 1, bitmap);
+        std::string out;
+        for (std::size_t k = 0; k + 1 < bounds.size(); k++)
+            out += bitmap[k / 64] >> (k % 64) & 1 ? "pass\n" : "error\n";
+        std::cout << out;
+        return 0;
+    }
+    if (argc > 2 && std::strcmp(argv[1], "match") == 0)
+    {
+        // regexAnalysis match <regex> [file] [线程数]：整个文件(或标准输入)是否匹配，输出pass或error；
+        // 文件用mmap映射，按线程数切块并行匹配，不给线程数时用全部核
+        dfaIdentity::DFA dfa;
+        if (!regexAnalysis::compile(argv[2], dfa))
+            return 1;
+        unsigned threads = argc > 4 ? std::atoi(argv[4]) : std::thread::hardware_concurrency();
+        bool result;
+        if (argc > 3)
+        {
+            int fd = open(argv[3], O_RDONLY);
+            struct stat st;
+            if (fd < 0 || fstat(fd, &st) != 0)
+            {
+                std::cerr << "could not open " << argv[3] << '\n';
+                return 1;
+            }
+            void *data = st.st_size > 0 ? mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+            if (data == MAP_FAILED)
+            {
+                std::cerr << "could not map " << argv[3] << '\n';
+                close(fd);
+                return 1;
+            }
+            result = dfa.matchParallel((const char *) data, st.st_size, threads);
+            if (data)
+                munmap(data, st.st_size);
+            close(fd);
+        } else
+        {
+            std::string text((std::istreambuf_iterator<char>(std::cin)), std::istreambuf_iterator<char>());
+            result = dfa.matchParallel(text.data(), text.size(), threads);
+        }
+        std::cout << (result ? "pass" : "error") << '\n';
+        return result ? 0 : 1;
+    }
+    if (argc > 2 && (std::strcmp(argv[1], "scan-nfa") == 0 || std::strcmp(argv[1], "scan-lazy") == 0))
+    {
+        // regexAnalysis scan-nfa <regex> [file]：同scan，但不确定化，直接模拟NFA
+        // regexAnalysis scan-lazy <regex> [file]：同scan，用惰性DFA，边匹配边构造
+        nfaIdentity::PikeVM vm;
+        nfaIdentity::LazyDFA lazy;
+        regex2nfa::NFA nfa;
+        if (!regexAnalysis::compileNFA(argv[2], nfa))
+            return 1;
+        if (std::strcmp(argv[1], "scan-nfa") == 0)
+            vm.creat_vm(nfa);
+        else
+            lazy.creat_lazy(nfa, true);
+        int fd = argc > 3 ? open(argv[3], O_RDONLY) : 0;
+        if (fd < 0)
+        {
+            std::cerr << "could not open " << argv[3] << '\n';
+            return 1;
+        }
+        long long count = std::strcmp(argv[1], "scan-nfa") == 0 ? vm.scan(fd, std::cout) : lazy.scan(fd, std::cout);
+        std::cerr << "matches: " << count << '\n';
+        if (fd != 0)
+            close(fd);
+        return 0;
+    }
+    if (argc > 2 && std::strcmp(argv[1], "scan") == 0)
+    {
+        // regexAnalysis scan <regex> [file]：在文件或标准输入中查找，输出每个匹配的结束位置
+        dfaIdentity::DFA dfa;
+        if (!regexAnalysis::compile(argv[2], dfa))
+            return 1;
+        dfa.creat_search();
+        int fd = argc > 3 ? open(argv[3], O_RDONLY) : 0;
+        if (fd < 0)
+        {
+            std::cerr << "could not open " << argv[3] << '\n';
+            return 1;
+        }
+        long long count = dfa.scan(fd, std::cout);
+        std::cerr << "matches: " << count << '\n';
+        if (fd != 0)
+            close(fd);
+        return 0;
+    }
+
+    std::string regex;
+    dfaIdentity::DFA dfa;
+
+    std::cout << "Please enter the regex:";
+    std::cin >> regex;
+    if (!regexAnalysis::compile(regex, dfa))
+        return 1;
+
+    // 之后每行一个以#结尾的单词，空行结束
+    dfa.get_string();
+    dfa.find_if();
     return 0;
 }
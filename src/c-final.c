@@ -1,6 +1,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #define int long long // to work with 64bit address
 
@@ -47,6 +51,7 @@ int *idmain;                    // the `main` function
 enum
 {
     LEA, IMM, JMP, CALL, JZ, JNZ, ENT, ADJ, LEV, LI, LC, SI, SC, PUSH,
+    BEQ, BNE, BLT, BGT, BLE, BGE, LLI, SLI, GLI, GSI,
     OR, XOR, AND, EQ, NE, LT, GT, LE, GE, SHL, SHR, ADD, SUB, MUL, DIV, MOD,
     OPEN, READ, CLOS, PRTF, MALC, MSET, MCMP, EXIT
 };
@@ -84,6 +89,12 @@ int expr_type;   // the type of an expression
 // 5: local var 1
 // 6: local var 2
 int index_of_bp; // index of bp pointer on stack
+int *last_target; // latest jump target patched inside an expression
+int *last_load;   // last folded variable load (LLI/GLI), see split_load()
+int verified;     // text passed verify(), eval() can skip its own checks
+int max_depth;    // deepest expression stack of any function, from verify()
+int compact;                // run the compact encoding of text, see encode()
+unsigned char *ctext;       // compact text segment
 
 void next()
 {
@@ -366,6 +377,19 @@ void match(int tk)
     }
 }
 
+void split_load()
+{
+    // `LLI <offset>` and `GLI <addr>` load an int variable in one go, but
+    // `&`, `++` and `--` need the address of the variable, so turn the load
+    // back into `LEA <offset>; LI` or `IMM <addr>; LI`.
+    if (last_load == text - 1)
+    {
+        *last_load = (*last_load == LLI) ? LEA : IMM;
+        *++text = LI;
+        last_load = 0;
+    }
+}
+
 void expression(int level)
 {
     // expressions have various format.
@@ -385,6 +409,7 @@ void expression(int level)
     int *id;
     int tmp;
     int *addr;
+    int store, slot; // store instruction and its operand for `var = expr`
     {
         if (!token)
         {
@@ -531,7 +556,16 @@ void expression(int level)
                 // emit code, default behaviour is to load the value of the
                 // address which is stored in `ax`
                 expr_type = id[Type];
-                *++text = (expr_type == CHAR) ? LC : LI;
+                if (expr_type == CHAR)
+                {
+                    *++text = LC;
+                } else
+                {
+                    // int and pointer variables are loaded in one
+                    // instruction without computing the address first
+                    *(text - 1) = (*(text - 1) == LEA) ? LLI : GLI;
+                    last_load = text - 1;
+                }
             }
         } else if (token == '(')
         {
@@ -579,6 +613,7 @@ void expression(int level)
             // get the address of
             match(And);
             expression(Inc); // get the address of
+            split_load();
             if (*text == LC || *text == LI)
             {
                 text--;
@@ -648,6 +683,7 @@ void expression(int level)
             tmp = token;
             match(token);
             expression(Inc);
+            split_load();
             if (*text == LC)
             {
                 *text = PUSH;  // to duplicate the address
@@ -683,7 +719,15 @@ void expression(int level)
             {
                 // var = expr;
                 match(Assign);
-                if (*text == LC || *text == LI)
+                store = 0;
+                if (last_load == text - 1)
+                {
+                    // store into the variable directly, no address needed
+                    store = (*last_load == LLI) ? SLI : GSI;
+                    slot = *text;
+                    text = text - 2;
+                    last_load = 0;
+                } else if (*text == LC || *text == LI)
                 {
                     *text = PUSH; // save the lvalue's pointer
                 } else
@@ -694,7 +738,14 @@ void expression(int level)
                 expression(Assign);
 
                 expr_type = tmp;
-                *++text = (expr_type == CHAR) ? SC : SI;
+                if (store)
+                {
+                    *++text = store;
+                    *++text = slot;
+                } else
+                {
+                    *++text = (expr_type == CHAR) ? SC : SI;
+                }
             } else if (token == Cond)
             {
                 // expr ? a : b;
@@ -715,6 +766,7 @@ void expression(int level)
                 addr = ++text;
                 expression(Cond);
                 *addr = (int) (text + 1);
+                last_target = text + 1;
             } else if (token == Lor)
             {
                 // logic or
@@ -723,6 +775,7 @@ void expression(int level)
                 addr = ++text;
                 expression(Lan);
                 *addr = (int) (text + 1);
+                last_target = text + 1;
                 expr_type = INT;
             } else if (token == Lan)
             {
@@ -732,6 +785,7 @@ void expression(int level)
                 addr = ++text;
                 expression(Or);
                 *addr = (int) (text + 1);
+                last_target = text + 1;
                 expr_type = INT;
             } else if (token == Or)
             {
@@ -897,6 +951,7 @@ void expression(int level)
                 // postfix inc(++) and dec(--)
                 // we will increase the value to the variable and decrease it
                 // on `ax` to get its original value.
+                split_load();
                 if (*text == LI)
                 {
                     *text = PUSH;
@@ -953,6 +1008,44 @@ void expression(int level)
     }
 }
 
+int *jump_if_false()
+{
+    // emit the jump taken when the condition in `ax` is false, return the
+    // address of its target so that the caller can fill it in later.
+    //
+    // a condition that ends with a compare against a constant is folded
+    // into a single compare-and-branch with the negated test:
+    //
+    //   <expr>                 <expr>
+    //   PUSH                   BGE k
+    //   IMM k                  <addr>
+    //   LT
+    //   JZ <addr>
+    //
+    // this is only safe if nothing jumps into the middle or the end of the
+    // folded instructions, e.g. `a && b < 10` must keep its `JZ`.
+    int op;
+    int k;
+
+    op = *text;
+    if (op >= EQ && op <= GE && text[-2] == IMM && text[-3] == PUSH && last_target <= text - 3)
+    {
+        k = text[-1];
+        text = text - 3;
+        if (op == EQ) *text = BNE;
+        else if (op == NE) *text = BEQ;
+        else if (op == LT) *text = BGE;
+        else if (op == GT) *text = BLE;
+        else if (op == LE) *text = BGT;
+        else *text = BLT;
+        *++text = k;
+        return ++text;
+    }
+
+    *++text = JZ;
+    return ++text;
+}
+
 void statement()
 {
     // there are 6 kinds of statements here:
@@ -984,8 +1077,7 @@ void statement()
         match(')');
 
         // emit code for if
-        *++text = JZ;
-        b = ++text;
+        b = jump_if_false();
 
         statement();         // parse statement
         if (token == Else)
@@ -1018,8 +1110,7 @@ void statement()
         expression(Assign);
         match(')');
 
-        *++text = JZ;
-        b = ++text;
+        b = jump_if_false();
 
         statement();
 
@@ -1359,16 +1450,321 @@ void program()
     }
 }
 
+int operands(int op)
+{
+    // number of operand slots following an instruction in text
+    if (op >= BEQ && op <= BGE)
+    {
+        return 2;
+    }
+    if (op <= ADJ || (op >= LLI && op <= GSI))
+    {
+        return 1;
+    }
+    return 0;
+}
+
+int verify_text(char *start, int *depth, int **work)
+{
+    // start[i] is set if text slot i begins an instruction, depth[i] is the
+    // stack depth before slot i (-1 if not reached yet), work holds the
+    // slots still to be walked. see verify().
+    int *p, *q, *t;
+    int n, op, d, top;
+
+    // instruction boundaries and opcode range
+    p = old_text + 1;
+    while (p <= text)
+    {
+        op = *p;
+        if (op < LEA || op > EXIT)
+        {
+            printf("verify: bad instruction %lld at %lld\n", op, (int) (p - old_text));
+            return 0;
+        }
+        start[p - old_text] = 1;
+        p = p + 1 + operands(op);
+    }
+    if (p != text + 1)
+    {
+        printf("verify: truncated instruction at the end of text\n");
+        return 0;
+    }
+
+    // jump and call targets
+    p = old_text + 1;
+    while (p <= text)
+    {
+        op = *p;
+        t = 0;
+        if (op == JMP || op == JZ || op == JNZ || op == CALL)
+        {
+            t = (int *) p[1];
+        } else if (op >= BEQ && op <= BGE)
+        {
+            t = (int *) p[2];
+        }
+        if (t && (t <= old_text || t > text || !start[t - old_text]))
+        {
+            printf("verify: bad jump target at %lld\n", (int) (p - old_text));
+            return 0;
+        }
+        if (op == CALL && *t != ENT)
+        {
+            printf("verify: call to a non-function at %lld\n", (int) (p - old_text));
+            return 0;
+        }
+        if (op == PRTF && p[1] != ADJ)
+        {
+            // printf takes its argument count from the following ADJ
+            printf("verify: printf without arguments at %lld\n", (int) (p - old_text));
+            return 0;
+        }
+        p = p + 1 + operands(op);
+    }
+
+    // stack depth of each function
+    p = old_text + 1;
+    while (p <= text)
+    {
+        if (*p == ENT)
+        {
+            depth[p - old_text] = 0;
+            work[0] = p;
+            top = 1;
+            while (top > 0)
+            {
+                q = work[--top];
+                op = *q;
+                d = depth[q - old_text];
+                if (op == PUSH) d++;
+                else if ((op >= OR && op <= MOD) || op == SI || op == SC) d--;
+                else if (op == ADJ) d = d - q[1];
+
+                if (d < 0)
+                {
+                    printf("verify: stack underflow at %lld\n", (int) (q - old_text));
+                    return 0;
+                }
+                if (d > max_depth)
+                {
+                    max_depth = d;
+                }
+                if (op == LEV && d != 0)
+                {
+                    printf("verify: unbalanced stack at %lld\n", (int) (q - old_text));
+                    return 0;
+                }
+
+                // successors: the jump target, then the next instruction
+                n = 0;
+                t = 0;
+                if (op == JMP || op == JZ || op == JNZ)
+                {
+                    t = (int *) q[1];
+                } else if (op >= BEQ && op <= BGE)
+                {
+                    t = (int *) q[2];
+                }
+                while (n < 2)
+                {
+                    if (n == 1)
+                    {
+                        t = (op == JMP || op == LEV || op == EXIT) ? 0 : q + 1 + operands(op);
+                    }
+                    if (t)
+                    {
+                        if (t > text || *t == ENT)
+                        {
+                            printf("verify: missing return at %lld\n", (int) (q - old_text));
+                            return 0;
+                        }
+                        if (depth[t - old_text] == -1)
+                        {
+                            depth[t - old_text] = d;
+                            work[top++] = t;
+                        } else if (depth[t - old_text] != d)
+                        {
+                            printf("verify: stack depth mismatch at %lld\n", (int) (t - old_text));
+                            return 0;
+                        }
+                    }
+                    n++;
+                }
+            }
+        }
+        p = p + 1 + operands(*p);
+    }
+    return 1;
+}
+
+int verify()
+{
+    // check the text segment before running it:
+    // 1. every slot walked from the first instruction is a known opcode or
+    //    one of its operands.
+    // 2. jumps and branches land on an instruction, calls land on an ENT.
+    // 3. starting from each ENT, every path reaches LEV with nothing left
+    //    on the stack, and merging paths agree on the stack depth.
+    // returns 1 if the code is fine, otherwise prints why and returns 0.
+    int n, ok;
+    char *start;
+    int *depth;
+    int **work;
+
+    n = text - old_text + 1;
+    start = malloc(n);
+    depth = malloc(n * sizeof(int));
+    work = malloc(n * sizeof(int *));
+    memset(start, 0, n);
+    memset(depth, -1, n * sizeof(int));
+
+    ok = verify_text(start, depth, work);
+
+    free(start);
+    free(depth);
+    free(work);
+    return ok;
+}
+
+// buffered input behind the open/read/close library calls.
+//
+// a regular file opened for reading is mapped as a whole and read() just
+// copies out of the mapping, anything else (pipes, devices) is read through
+// a large buffer so a script reading a few bytes at a time doesn't make a
+// system call for each of them.
+enum { IO_MAX = 256, IO_BUF_SIZE = 1024 * 1024 };
+
+char **io_buf;     // read buffer or mapping of each fd
+int *io_pos;       // next byte of io_buf to hand out
+int *io_len;       // bytes available in io_buf
+int *io_mapped;    // io_buf is a mapping of the whole file
+
+int io_open(char *path, int flags)
+{
+    int fd;
+    struct stat st;
+    char *map;
+
+    if (!io_buf)
+    {
+        io_buf = malloc(IO_MAX * sizeof(char *));
+        io_pos = malloc(IO_MAX * sizeof(int));
+        io_len = malloc(IO_MAX * sizeof(int));
+        io_mapped = malloc(IO_MAX * sizeof(int));
+        memset(io_buf, 0, IO_MAX * sizeof(char *));
+        memset(io_pos, 0, IO_MAX * sizeof(int));
+        memset(io_len, 0, IO_MAX * sizeof(int));
+        memset(io_mapped, 0, IO_MAX * sizeof(int));
+    }
+
+    fd = open(path, flags);
+    if (fd < 0 || fd >= IO_MAX)
+    {
+        return fd;
+    }
+    io_pos[fd] = io_len[fd] = 0;
+    if ((flags & O_ACCMODE) == O_RDONLY && !fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED)
+        {
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+            io_buf[fd] = map;
+            io_len[fd] = st.st_size;
+            io_mapped[fd] = 1;
+        }
+    }
+    return fd;
+}
+
+int io_read(int fd, char *buf, int n)
+{
+    if (!io_buf || fd < 0 || fd >= IO_MAX)
+    {
+        return read(fd, buf, n);
+    }
+    if (!io_mapped[fd] && io_pos[fd] == io_len[fd])
+    {
+        // buffer drained, large reads skip it
+        if (n >= IO_BUF_SIZE)
+        {
+            return read(fd, buf, n);
+        }
+        if (!io_buf[fd] && !(io_buf[fd] = malloc(IO_BUF_SIZE)))
+        {
+            return read(fd, buf, n);
+        }
+        io_pos[fd] = 0;
+        io_len[fd] = read(fd, io_buf[fd], IO_BUF_SIZE);
+        if (io_len[fd] <= 0)
+        {
+            n = io_len[fd];
+            io_len[fd] = 0;
+            return n;
+        }
+    }
+    if (n > io_len[fd] - io_pos[fd])
+    {
+        n = io_len[fd] - io_pos[fd];
+    }
+    memcpy(buf, io_buf[fd] + io_pos[fd], n);
+    io_pos[fd] = io_pos[fd] + n;
+    return n;
+}
+
+int io_close(int fd)
+{
+    if (io_buf && fd >= 0 && fd < IO_MAX && io_buf[fd])
+    {
+        if (io_mapped[fd])
+        {
+            munmap(io_buf[fd], io_len[fd]);
+        } else
+        {
+            free(io_buf[fd]);
+        }
+        io_buf[fd] = 0;
+        io_mapped[fd] = 0;
+    }
+    if (io_buf && fd >= 0 && fd < IO_MAX)
+    {
+        io_pos[fd] = io_len[fd] = 0;
+    }
+    return close(fd);
+}
 
 int eval()
 {
     int op, *tmp;
     while (1)
     {
+        if (!verified)
+        {
+            // code that failed verify() runs with its pc and sp checked
+            if (pc <= old_text || pc > text)
+            {
+                printf("pc out of text segment\n");
+                return -1;
+            }
+            if (sp <= stack || sp > (int *) ((int) stack + poolsize))
+            {
+                printf("stack overflow\n");
+                return -1;
+            }
+        }
         op = *pc++; // get next operation code
 
         if (op == IMM)
         { ax = *pc++; }                                     // load immediate value to ax
+        else if (op == LLI)
+        { ax = bp[*pc++]; }                                  // load local integer variable to ax
+        else if (op == GLI)
+        { ax = *(int *) *pc++; }                             // load global integer variable to ax
+        else if (op == SLI)
+        { bp[*pc++] = ax; }                                  // save ax to local integer variable
+        else if (op == GSI)
+        { *(int *) *pc++ = ax; }                             // save ax to global integer variable
         else if (op == LC)
         { ax = *(char *) ax; }                               // load character to ax, address in ax
         else if (op == LI)
@@ -1385,6 +1781,18 @@ int eval()
         { pc = ax ? pc + 1 : (int *) *pc; }                   // jump if ax is zero
         else if (op == JNZ)
         { pc = ax ? (int *) *pc : pc + 1; }                   // jump if ax is not zero
+        else if (op == BEQ)
+        { pc = ax == *pc ? (int *) pc[1] : pc + 2; }          // jump if ax equals the immediate
+        else if (op == BNE)
+        { pc = ax != *pc ? (int *) pc[1] : pc + 2; }          // jump if ax differs from the immediate
+        else if (op == BLT)
+        { pc = ax < *pc ? (int *) pc[1] : pc + 2; }           // jump if ax is less than the immediate
+        else if (op == BGT)
+        { pc = ax > *pc ? (int *) pc[1] : pc + 2; }           // jump if ax is greater than the immediate
+        else if (op == BLE)
+        { pc = ax <= *pc ? (int *) pc[1] : pc + 2; }          // jump if ax is not greater than the immediate
+        else if (op == BGE)
+        { pc = ax >= *pc ? (int *) pc[1] : pc + 2; }          // jump if ax is not less than the immediate
         else if (op == CALL)
         {
             *--sp = (int) (pc + 1);
@@ -1393,6 +1801,13 @@ int eval()
             //else if (op == RET)  {pc = (int *)*sp++;}                              // return from subroutine;
         else if (op == ENT)
         {
+            // the only check left for verified code: the new frame, its
+            // saved bp and its deepest expression must fit on the stack
+            if (sp - *pc - max_depth - 3 <= stack)
+            {
+                printf("stack overflow\n");
+                return -1;
+            }
             *--sp = (int) bp;
             bp = sp;
             sp = sp - *pc++;
@@ -1445,12 +1860,12 @@ int eval()
             printf("exit(%lld)", *sp);
             return *sp;
         }
-//        else if (op == OPEN)
-//        { ax = open((char *) sp[1], sp[0]); }
-//        else if (op == CLOS)
-//        { ax = close(*sp); }
-//        else if (op == READ)
-//        { ax = read(sp[2], (char *) sp[1], *sp); }
+        else if (op == OPEN)
+        { ax = io_open((char *) sp[1], sp[0]); }
+        else if (op == CLOS)
+        { ax = io_close(*sp); }
+        else if (op == READ)
+        { ax = io_read(sp[2], (char *) sp[1], *sp); }
         else if (op == PRTF)
         {
             tmp = sp + pc[1];
@@ -1470,6 +1885,205 @@ int eval()
     return 0;
 }
 
+int load4(unsigned char *c)
+{
+    // read a little-endian signed 32 bit operand of the compact encoding
+    return ((c[0] | c[1] << 8 | c[2] << 16 | (int) c[3] << 24) ^ 0x80000000) - 0x80000000;
+}
+
+void store4(unsigned char *c, int v)
+{
+    c[0] = v;
+    c[1] = v >> 8;
+    c[2] = v >> 16;
+    c[3] = v >> 24;
+}
+
+int *encode()
+{
+    // re-encode the verified text into ctext with one byte per opcode:
+    //
+    //   op         no operand
+    //   op | 64    4 byte signed operand follows
+    //   op | 128   8 byte operand follows
+    //
+    // jump and call targets become 4 byte offsets into ctext; BEQ..BGE
+    // keep their immediate as the operand and are followed by the offset.
+    // returns where[i], the offset in ctext of the instruction at text
+    // slot i.
+    int *where, *p;
+    int n, op, v, size;
+    unsigned char *c;
+
+    n = text - old_text + 1;
+    where = malloc(n * sizeof(int));
+
+    // lay out the instructions to know where the jumps go
+    size = 0;
+    p = old_text + 1;
+    while (p <= text)
+    {
+        op = *p;
+        where[p - old_text] = size;
+        size = size + 1;
+        v = p[1];
+        if (op == JMP || op == JZ || op == JNZ || op == CALL)
+        {
+            size = size + 4;
+        } else if (operands(op))
+        {
+            size = size + ((v + 0x80000000 >= 0 && v + 0x80000000 <= 0xffffffff) ? 4 : 8);
+        }
+        if (op >= BEQ && op <= BGE)
+        {
+            size = size + 4;
+        }
+        p = p + 1 + operands(op);
+    }
+
+    ctext = c = malloc(size);
+    p = old_text + 1;
+    while (p <= text)
+    {
+        op = *p;
+        if (op == JMP || op == JZ || op == JNZ || op == CALL)
+        {
+            *c++ = op | 64;
+            store4(c, where[(int *) p[1] - old_text]);
+            c = c + 4;
+        } else if (operands(op))
+        {
+            v = p[1];
+            if (v + 0x80000000 >= 0 && v + 0x80000000 <= 0xffffffff)
+            {
+                *c++ = op | 64;
+                store4(c, v);
+                c = c + 4;
+            } else
+            {
+                *c++ = op | 128;
+                memcpy(c, &v, sizeof(int));
+                c = c + sizeof(int);
+            }
+            if (op >= BEQ && op <= BGE)
+            {
+                store4(c, where[(int *) p[2] - old_text]);
+                c = c + 4;
+            }
+        } else
+        {
+            *c++ = op;
+        }
+        p = p + 1 + operands(op);
+    }
+    return where;
+}
+
+int eval_compact()
+{
+    // same as eval() but walks ctext, `pc` holds the first instruction and
+    // return addresses on the stack point into ctext.
+    int op, v, *tmp;
+    unsigned char *cp;
+
+    cp = (unsigned char *) pc;
+    v = 0;
+    while (1)
+    {
+        op = *cp++;
+        if (op & 64)
+        {
+            v = load4(cp);
+            cp = cp + 4;
+        } else if (op & 128)
+        {
+            memcpy(&v, cp, sizeof(int));
+            cp = cp + sizeof(int);
+        }
+        op = op & 63;
+
+        if (op == IMM) ax = v;
+        else if (op == LLI) ax = bp[v];
+        else if (op == GLI) ax = *(int *) v;
+        else if (op == SLI) bp[v] = ax;
+        else if (op == GSI) *(int *) v = ax;
+        else if (op == LC) ax = *(char *) ax;
+        else if (op == LI) ax = *(int *) ax;
+        else if (op == SC) ax = *(char *) *sp++ = ax;
+        else if (op == SI) *(int *) *sp++ = ax;
+        else if (op == PUSH) *--sp = ax;
+        else if (op == JMP) cp = ctext + v;
+        else if (op == JZ) cp = ax ? cp : ctext + v;
+        else if (op == JNZ) cp = ax ? ctext + v : cp;
+        else if (op == BEQ) cp = ax == v ? ctext + load4(cp) : cp + 4;
+        else if (op == BNE) cp = ax != v ? ctext + load4(cp) : cp + 4;
+        else if (op == BLT) cp = ax < v ? ctext + load4(cp) : cp + 4;
+        else if (op == BGT) cp = ax > v ? ctext + load4(cp) : cp + 4;
+        else if (op == BLE) cp = ax <= v ? ctext + load4(cp) : cp + 4;
+        else if (op == BGE) cp = ax >= v ? ctext + load4(cp) : cp + 4;
+        else if (op == CALL)
+        {
+            *--sp = (int) cp;
+            cp = ctext + v;
+        } else if (op == ENT)
+        {
+            if (sp - v - max_depth - 3 <= stack)
+            {
+                printf("stack overflow\n");
+                return -1;
+            }
+            *--sp = (int) bp;
+            bp = sp;
+            sp = sp - v;
+        } else if (op == ADJ) sp = sp + v;
+        else if (op == LEV)
+        {
+            sp = bp;
+            bp = (int *) *sp++;
+            cp = (unsigned char *) *sp++;
+        } else if (op == LEA) ax = (int) (bp + v);
+
+        else if (op == OR) ax = *sp++ | ax;
+        else if (op == XOR) ax = *sp++ ^ ax;
+        else if (op == AND) ax = *sp++ & ax;
+        else if (op == EQ) ax = *sp++ == ax;
+        else if (op == NE) ax = *sp++ != ax;
+        else if (op == LT) ax = *sp++ < ax;
+        else if (op == LE) ax = *sp++ <= ax;
+        else if (op == GT) ax = *sp++ > ax;
+        else if (op == GE) ax = *sp++ >= ax;
+        else if (op == SHL) ax = *sp++ << ax;
+        else if (op == SHR) ax = *sp++ >> ax;
+        else if (op == ADD) ax = *sp++ + ax;
+        else if (op == SUB) ax = *sp++ - ax;
+        else if (op == MUL) ax = *sp++ * ax;
+        else if (op == DIV) ax = *sp++ / ax;
+        else if (op == MOD) ax = *sp++ % ax;
+
+        else if (op == EXIT)
+        {
+            printf("exit(%lld)", *sp);
+            return *sp;
+        } else if (op == PRTF)
+        {
+            // the argument count is the operand of the following ADJ
+            tmp = sp + load4(cp + 1);
+            ax = printf((char *) tmp[-1], tmp[-2], tmp[-3], tmp[-4], tmp[-5], tmp[-6]);
+        } else if (op == OPEN) ax = io_open((char *) sp[1], sp[0]);
+        else if (op == CLOS) ax = io_close(*sp);
+        else if (op == READ) ax = io_read(sp[2], (char *) sp[1], *sp);
+        else if (op == MALC) ax = (int) malloc(*sp);
+        else if (op == MSET) ax = (int) memset((char *) sp[2], sp[1], *sp);
+        else if (op == MCMP) ax = memcmp((char *) sp[2], (char *) sp[1], *sp);
+        else
+        {
+            printf("unknown instruction:%lld\n", op);
+            return -1;
+        }
+    }
+    return 0;
+}
+
 #undef int // Mac/clang needs this to compile
 
 int main(int argc, char **argv)
@@ -1478,11 +2092,19 @@ int main(int argc, char **argv)
 
     unsigned int i;
     FILE *fd;
-    int *tmp;
+    int *tmp, *where;
 
     argc--;
     argv++;
 
+    // -c: run the compact encoding of the text segment
+    if (argc > 0 && **argv == '-' && (*argv)[1] == 'c' && (*argv)[2] == 0)
+    {
+        compact = 1;
+        --argc;
+        ++argv;
+    }
+
     poolsize = 256 * 1024; // arbitrary size
     line = 1;
 
@@ -1581,14 +2203,30 @@ int main(int argc, char **argv)
         return -1;
     }
 
+    // call exit if main returns
+    *++text = PUSH;
+    tmp = text;
+    *++text = EXIT;
+
+    verified = verify();
+    if (compact && !verified)
+    {
+        printf("compact text needs verified code, running text\n");
+        compact = 0;
+    }
+    if (compact)
+    {
+        where = encode();
+        pc = (int *) (ctext + where[pc - old_text]);
+        tmp = (int *) (ctext + where[tmp - old_text]);
+        free(where);
+    }
+
     // setup stack
     sp = (int *) ((int) stack + poolsize);
-    *--sp = EXIT; // call exit if main returns
-    *--sp = PUSH;
-    tmp = sp;
     *--sp = argc;
     *--sp = (int) argv;
     *--sp = (int) tmp;
 
-    return eval();
+    return compact ? eval_compact() : eval();
 }
\ No newline at end of file
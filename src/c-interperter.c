@@ -1,6 +1,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #define int long long
 
@@ -375,6 +379,113 @@ void program()
     }
 }
 
+// buffered input behind the open/read/close library calls.
+//
+// a regular file opened for reading is mapped as a whole and read() just
+// copies out of the mapping, anything else (pipes, devices) is read through
+// a large buffer so a script reading a few bytes at a time doesn't make a
+// system call for each of them.
+enum { IO_MAX = 256, IO_BUF_SIZE = 1024 * 1024 };
+
+char **io_buf;     // read buffer or mapping of each fd
+int *io_pos;       // next byte of io_buf to hand out
+int *io_len;       // bytes available in io_buf
+int *io_mapped;    // io_buf is a mapping of the whole file
+
+int io_open(char *path, int flags)
+{
+    int fd;
+    struct stat st;
+    char *map;
+
+    if (!io_buf)
+    {
+        io_buf = malloc(IO_MAX * sizeof(char *));
+        io_pos = malloc(IO_MAX * sizeof(int));
+        io_len = malloc(IO_MAX * sizeof(int));
+        io_mapped = malloc(IO_MAX * sizeof(int));
+        memset(io_buf, 0, IO_MAX * sizeof(char *));
+        memset(io_pos, 0, IO_MAX * sizeof(int));
+        memset(io_len, 0, IO_MAX * sizeof(int));
+        memset(io_mapped, 0, IO_MAX * sizeof(int));
+    }
+
+    fd = open(path, flags);
+    if (fd < 0 || fd >= IO_MAX)
+    {
+        return fd;
+    }
+    io_pos[fd] = io_len[fd] = 0;
+    if ((flags & O_ACCMODE) == O_RDONLY && !fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED)
+        {
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+            io_buf[fd] = map;
+            io_len[fd] = st.st_size;
+            io_mapped[fd] = 1;
+        }
+    }
+    return fd;
+}
+
+int io_read(int fd, char *buf, int n)
+{
+    if (!io_buf || fd < 0 || fd >= IO_MAX)
+    {
+        return read(fd, buf, n);
+    }
+    if (!io_mapped[fd] && io_pos[fd] == io_len[fd])
+    {
+        // buffer drained, large reads skip it
+        if (n >= IO_BUF_SIZE)
+        {
+            return read(fd, buf, n);
+        }
+        if (!io_buf[fd] && !(io_buf[fd] = malloc(IO_BUF_SIZE)))
+        {
+            return read(fd, buf, n);
+        }
+        io_pos[fd] = 0;
+        io_len[fd] = read(fd, io_buf[fd], IO_BUF_SIZE);
+        if (io_len[fd] <= 0)
+        {
+            n = io_len[fd];
+            io_len[fd] = 0;
+            return n;
+        }
+    }
+    if (n > io_len[fd] - io_pos[fd])
+    {
+        n = io_len[fd] - io_pos[fd];
+    }
+    memcpy(buf, io_buf[fd] + io_pos[fd], n);
+    io_pos[fd] = io_pos[fd] + n;
+    return n;
+}
+
+int io_close(int fd)
+{
+    if (io_buf && fd >= 0 && fd < IO_MAX && io_buf[fd])
+    {
+        if (io_mapped[fd])
+        {
+            munmap(io_buf[fd], io_len[fd]);
+        } else
+        {
+            free(io_buf[fd]);
+        }
+        io_buf[fd] = 0;
+        io_mapped[fd] = 0;
+    }
+    if (io_buf && fd >= 0 && fd < IO_MAX)
+    {
+        io_pos[fd] = io_len[fd] = 0;
+    }
+    return close(fd);
+}
+
 int eval()
 {
     int op, *tmp;
@@ -455,19 +566,15 @@ int eval()
                     printf("exit(%lld)", *sp);
                     return *sp;
                 }
-                    // TODO: fix this 3 item
                 else if (op == OPEN)
                 {
-//                    ax = fopen((char *) sp[1], sp[0]);
-                    printf("open not support!\n");
+                    ax = io_open((char *) sp[1], sp[0]);
                 } else if (op == CLOS)
                 {
-//                    ax = fclose(*sp);
-                    printf("close not support!\n");
+                    ax = io_close(*sp);
                 } else if (op == READ)
                 {
-//                    ax = fread(sp[2], (char *)sp[1], *sp);
-                    printf("read not support!\n");
+                    ax = io_read(sp[2], (char *) sp[1], *sp);
                 } else if (op == PRTF)
                 {
                     tmp = sp + pc[1];